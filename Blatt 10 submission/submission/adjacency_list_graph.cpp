@@ -1,56 +1,205 @@
 #include "adjacency_list_graph.h"
 
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <iterator>
 #include <stdexcept>
 #include <algorithm>
+#include <bit>
 #include <string>
+#include <utility>
 #include <vector>
 
+namespace {
+
+    /// the weight that remains of two edges between the same nodes, earlier is the one in the graph or given first
+    float merge_weights(float earlier, float later, DuplicateEdges duplicates)
+    {
+        switch (duplicates) {
+            case DuplicateEdges::KeepFirst: return earlier;
+            case DuplicateEdges::KeepLast: return later;
+            case DuplicateEdges::KeepMin: return std::min(earlier, later);
+            case DuplicateEdges::KeepMax: return std::max(earlier, later);
+            case DuplicateEdges::Sum: return earlier+later;
+            case DuplicateEdges::Throw: break;
+        }
+        throw std::runtime_error("edge already exists");
+    }
+}
+
 void detail::AdjacencyListGraphBase::add_edge(uint32_t from, uint32_t to, float weight)
 {
     // TODO: task 10.1 a)
-    size_t size_nodes = edges.size();
-    if (from >= size_nodes) edges.resize(from+1);
-    size_t size_edges = edges[from].size();
-    for (size_t i = 0; i < size_edges; i++){
-        if(edges[from][i].first == to){
+    if (std::isnan(weight))
+        throw std::invalid_argument("edge weight must not be NaN");
+    if (from >= edges.size())
+        resize_rows(size_t{from}+1);
+    auto& row = edges[from];
+    if (const size_t found = find_edge(from, to); found != EdgeIndex::not_found) {
+        if (!is_removed(row[found]))
             throw std::runtime_error("edge already exists");
-            return;
+        // a removed edge that is still stored comes back in its old position
+        ++edge_version;
+        row[found].second = weight;
+        --tombstones[from];
+        --num_tombstones;
+        return;
+    }
+    ++edge_version;
+    if (tombstones[from] > 0 && static_cast<float>(tombstones[from]) >= compaction_threshold*static_cast<float>(row.size()))
+        compact_row(from);
+
+    size_t position = row.size();
+    if (sorted_rows())
+        position = static_cast<size_t>(std::lower_bound(row.begin(), row.end(), to, [](const auto& edge, uint32_t target) { return edge.first < target; })-row.begin());
+    row.insert(row.begin()+static_cast<std::ptrdiff_t>(position), {to, weight});
+    if (const auto it = hub_indices.find(from); it != hub_indices.end()) {
+        it->second.shift(position, 1);
+        it->second.insert(row, position);
+    }
+    else if (row.size() >= hash_index_degree)
+        hub_indices.emplace(from, EdgeIndex(row));
+}
+
+void detail::AdjacencyListGraphBase::add_edges(std::span<const Edge> new_edges, DuplicateEdges duplicates)
+{
+    if (new_edges.empty())
+        return;
+    uint32_t max_from = 0;
+    for (const Edge& edge : new_edges) {
+        if (std::isnan(edge.weight))
+            throw std::invalid_argument("edge weight must not be NaN");
+        max_from = std::max(max_from, edge.from);
+    }
+    const size_t num_rows = std::max(edges.size(), size_t{max_from}+1);
+
+    // 1. counting sort by start node, which keeps the given order of the edges of each node
+    std::vector<size_t> row_offsets(num_rows+1, 0);
+    for (const Edge& edge : new_edges)
+        ++row_offsets[edge.from+1];
+    for (size_t i=0; i<num_rows; ++i)
+        row_offsets[i+1] += row_offsets[i];
+    std::vector<Edge> sorted(new_edges.size());
+    {
+        std::vector<size_t> next(row_offsets.begin(), row_offsets.end()-1);
+        for (const Edge& edge : new_edges)
+            sorted[next[edge.from]++] = edge;
+    }
+
+    // 2. sort every group by target; with DuplicateEdges::Throw, check for duplicates before the graph is changed
+    const auto by_target = [](const Edge& a, const Edge& b) { return a.to < b.to; };
+    // targets of the edges that are in the graph already, with their position in the list, sorted by target
+    std::vector<std::pair<uint32_t, size_t>> existing;
+    const auto sort_existing = [&](const std::vector<std::pair<uint32_t, float>>& row) {
+        existing.clear();
+        for (size_t i=0; i<row.size(); ++i)
+            if (!is_removed(row[i]))
+                existing.emplace_back(row[i].first, i);
+        std::sort(existing.begin(), existing.end());
+    };
+    const auto find_existing = [&](uint32_t to) {
+        const auto it = std::lower_bound(existing.begin(), existing.end(), std::make_pair(to, size_t{0}));
+        return it != existing.end() && it->first == to ? it : existing.end();
+    };
+    for (size_t node=0; node<num_rows; ++node) {
+        const auto first = sorted.begin()+static_cast<std::ptrdiff_t>(row_offsets[node]);
+        const auto last = sorted.begin()+static_cast<std::ptrdiff_t>(row_offsets[node+1]);
+        std::stable_sort(first, last, by_target);
+        if (duplicates != DuplicateEdges::Throw || first == last)
+            continue;
+        if (std::adjacent_find(first, last, [](const Edge& a, const Edge& b) { return a.to == b.to; }) != last)
+            throw std::runtime_error("edge already exists");
+        if (node < edges.size() && !edges[node].empty()) {
+            for (auto it=first; it!=last; ++it) {
+                const size_t found = find_edge(static_cast<uint32_t>(node), it->to);
+                if (found != EdgeIndex::not_found && !is_removed(edges[node][found]))
+                    throw std::runtime_error("edge already exists");
+            }
+        }
+    }
+
+    // 3. merge the groups into the lists, each list is allocated once with its final size
+    ++edge_version;
+    if (edges.size() < num_rows)
+        resize_rows(num_rows);
+    std::vector<std::pair<uint32_t, float>> row;
+    for (size_t node=0; node<num_rows; ++node) {
+        const size_t begin = row_offsets[node];
+        const size_t end = row_offsets[node+1];
+        if (begin == end)
+            continue;
+        auto& old_row = edges[node];
+        row.clear();
+        row.reserve(old_row.size()-tombstones[node]+end-begin);
+        // removed edges are dropped from every list that is rebuilt
+        std::copy_if(old_row.begin(), old_row.end(), std::back_inserter(row), [](const auto& edge) { return !is_removed(edge); });
+        num_tombstones -= tombstones[node];
+        tombstones[node] = 0;
+        const size_t num_old = row.size();
+        sort_existing(row);
+        for (size_t i=begin; i<end; ++i) {
+            const Edge& edge = sorted[i];
+            if (const auto it = find_existing(edge.to); it != existing.end())
+                row[it->second].second = merge_weights(row[it->second].second, edge.weight, duplicates);
+            else if (row.size() > num_old && row.back().first == edge.to)
+                row.back().second = merge_weights(row.back().second, edge.weight, duplicates);
+            else
+                row.emplace_back(edge.to, edge.weight);
         }
+        // the new edges were appended sorted by target
+        if (sorted_rows())
+            std::inplace_merge(row.begin(), row.begin()+static_cast<std::ptrdiff_t>(num_old), row.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        // the range constructor allocates exactly row.size() elements
+        old_row = std::vector<std::pair<uint32_t, float>>(row.begin(), row.end());
+        update_hub_index(static_cast<uint32_t>(node));
     }
-    edges[from].resize(size_edges + 1);
-    edges[from][size_edges] = std::make_pair(to,weight);
 }
 
 void detail::AdjacencyListGraphBase::remove_edge(uint32_t from, uint32_t to)
 {
     // TODO: task 10.1 b)
-    if(edges.size() > from){
-        size_t size = edges[from].size();
-        for (size_t i=0; i < size; i++){
-            if(edges[from][i].first == to){
-                for (size_t j=i; j < size -1; j++){
-                    edges[from][j] = edges[from][j+1];
-                }
-                edges[from].pop_back();
-                return;
+    const size_t position = find_edge(from, to);
+    if (position == EdgeIndex::not_found || is_removed(edges[from][position]))
+        throw std::runtime_error("edge does not exist");
+    ++edge_version;
+    auto& row = edges[from];
+    const auto it = hub_indices.find(from);
+    EdgeIndex* index = it != hub_indices.end() ? &it->second : nullptr;
+    switch (removal) {
+        case EdgeRemoval::Ordered:
+            if (index) {
+                index->erase(row, position);
+                index->shift(position+1, -1);
             }
-        }
+            row.erase(row.begin()+static_cast<std::ptrdiff_t>(position));
+            break;
+        case EdgeRemoval::SwapAndPop:
+            if (index) {
+                index->erase(row, position);
+                if (position+1 < row.size())
+                    index->move(row.back().first, row.size()-1, position);
+            }
+            row[position] = row.back();
+            row.pop_back();
+            break;
+        case EdgeRemoval::Tombstone:
+            row[position].second = NAN;
+            ++tombstones[from];
+            ++num_tombstones;
+            return;
     }
-    throw std::runtime_error("edge does not exist");
+    if (index && row.size() < hash_index_degree/2)
+        hub_indices.erase(it);
 }
 
 std::optional<float> detail::AdjacencyListGraphBase::get_edge(uint32_t from, uint32_t to) const
 {
     // TODO: task 10.1 c)
-    if (edges.size() > from){
-        std::vector<std::pair<uint32_t, float>> node = edges[from];
-        for (size_t i = 0; i < edges[from].size(); i++){
-            if(edges[from][i].first == to) return edges[from][i].second;
-        }
-    }
-    return std::optional<float>{};
+    const size_t position = find_edge(from, to);
+    if (position == EdgeIndex::not_found || is_removed(edges[from][position]))
+        return std::optional<float>{};
+    return edges[from][position].second;
 }
 
 const std::vector<std::pair<uint32_t, float>>& detail::AdjacencyListGraphBase::get_edges_starting_at(uint32_t node) const
@@ -63,3 +212,286 @@ const std::vector<std::pair<uint32_t, float>>& detail::AdjacencyListGraphBase::g
         return empty;
     }
 }
+
+void detail::AdjacencyListGraphBase::set_edge_removal(EdgeRemoval mode, float threshold)
+{
+    if (!(threshold >= 0.0f && threshold <= 1.0f))
+        throw std::invalid_argument("the compaction threshold must be between 0 and 1");
+    const bool was_sorted = sorted_rows();
+    removal = mode;
+    compaction_threshold = threshold;
+    if (mode != EdgeRemoval::Tombstone)
+        compact_edges();
+    if (sorted_rows() && !was_sorted) {
+        for (size_t node=0; node<edges.size(); ++node) {
+            std::sort(edges[node].begin(), edges[node].end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            update_hub_index(static_cast<uint32_t>(node));
+        }
+    }
+}
+
+void detail::AdjacencyListGraphBase::compact_edges()
+{
+    for (size_t node=0; node<edges.size() && num_tombstones > 0; ++node)
+        if (tombstones[node] > 0)
+            compact_row(static_cast<uint32_t>(node));
+}
+
+void detail::AdjacencyListGraphBase::compact_row(uint32_t node)
+{
+    std::erase_if(edges[node], [](const auto& edge) { return is_removed(edge); });
+    num_tombstones -= tombstones[node];
+    tombstones[node] = 0;
+    update_hub_index(node);
+}
+
+size_t detail::AdjacencyListGraphBase::find_edge(uint32_t from, uint32_t to) const
+{
+    if (from >= edges.size())
+        return EdgeIndex::not_found;
+    const auto& row = edges[from];
+    if (const EdgeIndex* index = hub_index(from))
+        return index->find(row, to);
+    if (sorted_rows()) {
+        const auto it = std::lower_bound(row.begin(), row.end(), to, [](const auto& edge, uint32_t target) { return edge.first < target; });
+        return it != row.end() && it->first == to ? static_cast<size_t>(it-row.begin()) : EdgeIndex::not_found;
+    }
+    const auto it = std::find_if(row.begin(), row.end(), [=](const auto& edge) { return edge.first == to; });
+    return it != row.end() ? static_cast<size_t>(it-row.begin()) : EdgeIndex::not_found;
+}
+
+const detail::EdgeIndex* detail::AdjacencyListGraphBase::hub_index(uint32_t node) const
+{
+    // small lists never have an index, this saves the lookup in the map
+    if (edges[node].size() < hash_index_degree/2)
+        return nullptr;
+    const auto it = hub_indices.find(node);
+    return it != hub_indices.end() ? &it->second : nullptr;
+}
+
+void detail::AdjacencyListGraphBase::update_hub_index(uint32_t node)
+{
+    const auto& row = edges[node];
+    const auto it = hub_indices.find(node);
+    if (row.size() < hash_index_degree/2 || (it == hub_indices.end() && row.size() < hash_index_degree)) {
+        if (it != hub_indices.end())
+            hub_indices.erase(it);
+    }
+    else if (it != hub_indices.end())
+        it->second.rebuild(row);
+    else
+        hub_indices.emplace(node, EdgeIndex(row));
+}
+
+void detail::EdgeIndex::rebuild(const Row& row)
+{
+    size_t capacity = 16;
+    while (capacity < 2*row.size())
+        capacity *= 2;
+    slots.assign(capacity, 0);
+    shift_bits = 64-static_cast<unsigned>(std::countr_zero(capacity));
+    num_entries = 0;
+    for (size_t position=0; position<row.size(); ++position)
+        insert(row, position);
+}
+
+size_t detail::EdgeIndex::find(const Row& row, uint32_t to) const
+{
+    const size_t mask = slots.size()-1;
+    for (size_t slot = home_slot(to); slots[slot] != 0; slot = (slot+1)&mask)
+        if (row[slots[slot]-1].first == to)
+            return slots[slot]-1;
+    return not_found;
+}
+
+void detail::EdgeIndex::insert(const Row& row, size_t position)
+{
+    // at most half of the slots are used
+    if (2*(num_entries+1) > slots.size()) {
+        rebuild(row);
+        return;
+    }
+    const size_t mask = slots.size()-1;
+    size_t slot = home_slot(row[position].first);
+    while (slots[slot] != 0)
+        slot = (slot+1)&mask;
+    slots[slot] = static_cast<uint32_t>(position+1);
+    ++num_entries;
+}
+
+size_t detail::EdgeIndex::slot_of(const Row& row, size_t position) const
+{
+    const size_t mask = slots.size()-1;
+    size_t slot = home_slot(row[position].first);
+    while (slots[slot] != position+1)
+        slot = (slot+1)&mask;
+    return slot;
+}
+
+void detail::EdgeIndex::erase(const Row& row, size_t position)
+{
+    // backward shift deletion: entries behind the gap move into it unless that would put them before their home slot
+    const size_t mask = slots.size()-1;
+    size_t gap = slot_of(row, position);
+    slots[gap] = 0;
+    for (size_t slot = (gap+1)&mask; slots[slot] != 0; slot = (slot+1)&mask) {
+        const size_t home = home_slot(row[slots[slot]-1].first);
+        // distance from home to slot is at least the distance from gap to slot: the entry may fill the gap
+        if (((slot-home)&mask) >= ((slot-gap)&mask)) {
+            slots[gap] = slots[slot];
+            slots[slot] = 0;
+            gap = slot;
+        }
+    }
+    --num_entries;
+}
+
+void detail::EdgeIndex::move(uint32_t to, size_t old_position, size_t new_position)
+{
+    const size_t mask = slots.size()-1;
+    size_t slot = home_slot(to);
+    while (slots[slot] != old_position+1)
+        slot = (slot+1)&mask;
+    slots[slot] = static_cast<uint32_t>(new_position+1);
+}
+
+void detail::EdgeIndex::shift(size_t first, int delta)
+{
+    for (uint32_t& slot : slots)
+        if (slot != 0 && slot-1 >= first)
+            slot = static_cast<uint32_t>(static_cast<int64_t>(slot)+delta);
+}
+
+void detail::AdjacencyListGraphBase::resize_rows(size_t num_rows)
+{
+    edges.resize(num_rows);
+    tombstones.resize(num_rows, 0);
+}
+
+uint64_t detail::AdjacencyListGraphBase::count_edges(size_t num_nodes) const
+{
+    uint64_t num_edges = 0;
+    for (size_t node=0; node<edges.size(); ++node) {
+        const size_t live = edges[node].size()-tombstones[node];
+        if (node >= num_nodes && live > 0)
+            throw std::logic_error("edges start at a node that does not exist");
+        num_edges += live;
+    }
+    return num_edges;
+}
+
+void detail::AdjacencyListGraphBase::write_edges(GraphFileWriter& writer, const GraphFileHeader& header) const
+{
+    const size_t num_nodes = header.num_nodes;
+    const auto row_of = [&](size_t node) -> const std::vector<std::pair<uint32_t, float>>& {
+        static const std::vector<std::pair<uint32_t, float>> empty;
+        return node < edges.size() ? edges[node] : empty;
+    };
+
+    // 1. offsets, written in chunks
+    writer.next_block(header.offsets_offset);
+    std::vector<uint64_t> offsets;
+    offsets.reserve(std::min<size_t>(num_nodes+1, 1 << 17));
+    uint64_t offset = 0;
+    offsets.push_back(offset);
+    for (size_t node=0; node<num_nodes; ++node) {
+        offset += row_of(node).size()-(node < tombstones.size() ? tombstones[node] : 0);
+        offsets.push_back(offset);
+        if (offsets.size() == offsets.capacity()) {
+            writer.write(offsets.data(), offsets.size()*sizeof(uint64_t));
+            offsets.clear();
+        }
+    }
+    writer.write(offsets.data(), offsets.size()*sizeof(uint64_t));
+
+    // 2. targets and weights, each gathered from the lists into a buffer that is written when it is full
+    std::vector<std::pair<uint32_t, float>> sorted;
+    const auto write_column = [&](auto value_of) {
+        using Value = decltype(value_of(std::pair<uint32_t, float>{}));
+        std::vector<Value> buffer;
+        buffer.reserve(1 << 18);
+        for (size_t node=0; node<num_nodes; ++node) {
+            const auto* row = &row_of(node);
+            if (!sorted_rows() && row->size() > 1) {
+                sorted.assign(row->begin(), row->end());
+                std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+                row = &sorted;
+            }
+            for (const auto& edge : *row) {
+                if (is_removed(edge))
+                    continue;
+                buffer.push_back(value_of(edge));
+                if (buffer.size() == buffer.capacity()) {
+                    writer.write(buffer.data(), buffer.size()*sizeof(Value));
+                    buffer.clear();
+                }
+            }
+        }
+        writer.write(buffer.data(), buffer.size()*sizeof(Value));
+    };
+    writer.next_block(header.targets_offset);
+    write_column([](const std::pair<uint32_t, float>& edge) { return edge.first; });
+    writer.next_block(header.weights_offset);
+    write_column([](const std::pair<uint32_t, float>& edge) { return edge.second; });
+}
+
+void detail::AdjacencyListGraphBase::read_edges(GraphFileReader& reader)
+{
+    const GraphFileHeader& header = reader.get_header();
+    const size_t num_nodes = header.num_nodes;
+    const size_t num_edges = header.num_edges;
+    const auto corrupt = [] { return std::runtime_error("the graph file is corrupt"); };
+
+    std::vector<uint64_t> offsets(num_nodes+1);
+    reader.read(header.offsets_offset, offsets.data(), offsets.size()*sizeof(uint64_t));
+    if (offsets.front() != 0 || offsets.back() != num_edges || !std::is_sorted(offsets.begin(), offsets.end()))
+        throw corrupt();
+
+    // every list is allocated with its exact size and gets its targets, then the weights follow in chunks
+    std::vector<uint32_t> targets(num_edges);
+    reader.read(header.targets_offset, targets.data(), targets.size()*sizeof(uint32_t));
+    ++edge_version;
+    edges.clear();
+    tombstones.clear();
+    num_tombstones = 0;
+    hub_indices.clear();
+    resize_rows(num_nodes);
+    for (size_t node=0; node<num_nodes; ++node) {
+        auto& row = edges[node];
+        row.reserve(offsets[node+1]-offsets[node]);
+        for (uint64_t e=offsets[node]; e<offsets[node+1]; ++e)
+            row.emplace_back(targets[e], 0.0f);
+    }
+    targets = std::vector<uint32_t>();
+    std::vector<float> weights(std::min<size_t>(num_edges, 1 << 18));
+    size_t node = 0;
+    size_t position = 0;
+    for (size_t first=0; first<num_edges; first+=weights.size()) {
+        const size_t count = std::min(weights.size(), num_edges-first);
+        reader.read(header.weights_offset+first*sizeof(float), weights.data(), count*sizeof(float));
+        for (size_t i=0; i<count; ++i) {
+            while (position == edges[node].size()) {
+                ++node;
+                position = 0;
+            }
+            if (std::isnan(weights[i]))
+                throw corrupt();
+            edges[node][position++].second = weights[i];
+        }
+    }
+    reader.finish();
+
+    // the targets of every node are strictly increasing in a valid file
+    for (size_t i=0; i<num_nodes; ++i) {
+        const auto& row = edges[i];
+        if (std::adjacent_find(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first >= b.first; }) != row.end())
+            throw corrupt();
+        update_hub_index(static_cast<uint32_t>(i));
+    }
+}
+
+void EdgeBuilder::build(detail::AdjacencyListGraphBase& graph, DuplicateEdges duplicates)
+{
+    graph.add_edges(edges, duplicates);
+    edges = std::vector<Edge>();
+}
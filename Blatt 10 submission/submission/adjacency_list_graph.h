@@ -1,16 +1,78 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <iterator>
 #include <stdexcept>
-#include <fstream>
+#include <span>
 #include <type_traits>
 #include <utility>
 #include <vector>
 #include <string>
 #include <optional>
+#include <unordered_map>
+
+#include "compressed_graph.h"
+#include "frozen_graph.h"
+#include "graph_file.h"
+
+/// an edge for bulk loading with add_edges
+struct Edge {
+    uint32_t from, to;
+    float weight = 1.0f;
+};
+
+/// what add_edges does with several edges between the same pair of nodes, including an edge that is already in the graph
+enum class DuplicateEdges {
+    Throw,      // throw std::runtime_error (like add_edge) and leave the graph unchanged
+    KeepFirst,  // keep the weight of the edge in the graph, otherwise of the first one given
+    KeepLast,   // keep the weight of the last one given
+    KeepMin,
+    KeepMax,
+    Sum,
+};
+
+/// how remove_edge takes an edge out of the list of its start node
+enum class EdgeRemoval {
+    Ordered,     // close the gap by moving the following edges, the remaining edges keep their order
+    SwapAndPop,  // move the last edge into the gap in O(1), for users that do not depend on the order
+    Tombstone,   // only mark the edge as removed, every edge keeps its position until the list is compacted
+};
 
 namespace detail {
 
+    /// Open-addressing hash table (linear probing) from the target of an edge to its position in the list of its
+    /// start node. The targets are not stored in the table but looked up in the list.
+    class EdgeIndex {
+    public:
+        using Row = std::vector<std::pair<uint32_t, float>>;
+        static constexpr size_t not_found = SIZE_MAX;
+
+        explicit EdgeIndex(const Row& row) { rebuild(row); }
+
+        void rebuild(const Row& row);
+        /// position of the edge towards to in row, not_found if there is none
+        size_t find(const Row& row, uint32_t to) const;
+        /// adds row[position]; the positions of the other edges must be up to date (see shift)
+        void insert(const Row& row, size_t position);
+        /// drops row[position], to be called before the edge is taken out of row
+        void erase(const Row& row, size_t position);
+        /// the edge towards to moved from old_position to new_position
+        void move(uint32_t to, size_t old_position, size_t new_position);
+        /// adds delta to every position >= first
+        void shift(size_t first, int delta);
+
+    private:
+        size_t home_slot(uint32_t to) const { return static_cast<size_t>((to*UINT64_C(0x9E3779B97F4A7C15)) >> shift_bits); }
+        size_t slot_of(const Row& row, size_t position) const;
+
+        /// position+1 of an edge, 0 for empty slots; the size is a power of two
+        std::vector<uint32_t> slots;
+        unsigned shift_bits = 64;
+        size_t num_entries = 0;
+    };
+
     // This class contains all parts of AdjacencyListGraph that do not depend on the template parameter.
     // This allows us to write the implementation of these functions without template declaration.
     // Also, the compiler will not have to instantiate a copy of the function for each template type.
@@ -20,10 +82,66 @@ namespace detail {
         // these are the edges in the graph - each outbound edge comes with a weight
         std::vector<std::vector<std::pair<uint32_t, float>>> edges;
 
+        // removed edges per node that are still stored (EdgeRemoval::Tombstone), in total num_tombstones
+        std::vector<uint32_t> tombstones;
+        size_t num_tombstones = 0;
+        EdgeRemoval removal = EdgeRemoval::Ordered;
+        float compaction_threshold = 0.25f;
+
         virtual size_t get_num_nodes() const = 0; // call the derived class to get the number of nodes
 
+        // incremented whenever an edge is added, removed or gets a new weight
+        uint64_t edge_version = 0;
+
+        // hash indices of the nodes with at least hash_index_degree edges (dropped below half of that)
+        std::unordered_map<uint32_t, EdgeIndex> hub_indices;
+
+        void resize_rows(size_t num_rows);
+        void compact_row(uint32_t node);
+        /// lists are sorted by target, except with EdgeRemoval::SwapAndPop
+        bool sorted_rows() const { return removal != EdgeRemoval::SwapAndPop; }
+        /// position of the edge (including removed ones that are still stored), EdgeIndex::not_found if there is none
+        size_t find_edge(uint32_t from, uint32_t to) const;
+        const EdgeIndex* hub_index(uint32_t node) const;
+        /// creates, rebuilds or drops the hash index of node after its list was changed as a whole
+        void update_hub_index(uint32_t node);
+
+        /// number of edges (without removed ones) that start at the first num_nodes nodes, throws std::logic_error if
+        /// edges start at other nodes
+        uint64_t count_edges(size_t num_nodes) const;
+        /// the offsets, targets and weights blocks of a graph file
+        void write_edges(GraphFileWriter& writer, const GraphFileHeader& header) const;
+        /// replaces all edges by the ones in the file, which is then finished
+        void read_edges(GraphFileReader& reader);
+
     public:
+        /// Edge lookups use a binary search in the list of the start node, which is kept sorted by target. Nodes with
+        /// at least this many edges get a hash index instead. With EdgeRemoval::SwapAndPop the lists are not sorted,
+        /// the edges of nodes without a hash index are then searched linearly.
+        static constexpr size_t hash_index_degree = 128;
+
+        /// With EdgeRemoval::Tombstone, removing an edge never moves other edges, so a list can be iterated while
+        /// edges are removed from it. The removed edges stay in the lists (see is_removed) until compact_edges() or
+        /// until an edge is added to a list in which at least compaction_threshold of the edges are removed; adding
+        /// an edge may reallocate the list anyway. Leaving the tombstone mode compacts all lists, leaving the
+        /// swap-and-pop mode sorts them.
+        void set_edge_removal(EdgeRemoval mode, float threshold=0.25f);
+        EdgeRemoval get_edge_removal() const { return removal; }
+        /// drops all removed edges that are still stored
+        void compact_edges();
+        size_t get_num_tombstones() const { return num_tombstones; }
+        /// changes whenever an edge is added, removed or gets a new weight (not when the lists are only compacted or
+        /// reordered), so that data derived from the edges can tell whether it is out of date
+        uint64_t get_edge_version() const { return edge_version; }
+        /// whether an edge in a list returned by get_edges_starting_at was removed (only in tombstone mode)
+        static bool is_removed(const std::pair<uint32_t, float>& edge) { return std::isnan(edge.second); }
+
+        /// the weight must not be NaN, NaN marks removed edges
         void add_edge(uint32_t from, uint32_t to, float weight=1.0f);
+        /// adds many edges at once in time linear in their number (plus sorting the edges of each node by target):
+        /// the edges are grouped by their start node, merged according to duplicates and every touched list is
+        /// rebuilt with its exact size
+        void add_edges(std::span<const Edge> new_edges, DuplicateEdges duplicates=DuplicateEdges::Throw);
         void remove_edge(uint32_t from, uint32_t to);
         std::optional<float> get_edge(uint32_t from, uint32_t to) const;
 
@@ -31,6 +149,20 @@ namespace detail {
     };
 }
 
+/// collects edges, e.g. while parsing a file, and adds all of them to a graph with a single add_edges call
+class EdgeBuilder {
+public:
+    void reserve(size_t num_edges) { edges.reserve(num_edges); }
+    void add_edge(uint32_t from, uint32_t to, float weight=1.0f) { edges.push_back({from, to, weight}); }
+    size_t size() const { return edges.size(); }
+
+    /// adds the collected edges to graph and releases them
+    void build(detail::AdjacencyListGraphBase& graph, DuplicateEdges duplicates=DuplicateEdges::Throw);
+
+private:
+    std::vector<Edge> edges;
+};
+
 template <typename TNode, typename TDerived=void> // using CRTP to create instances of the derived type during deserialization
 class AdjacencyListGraph : public detail::AdjacencyListGraphBase, private std::vector<TNode> {
 private:
@@ -57,35 +189,59 @@ public:
         this->resize(num_nodes);
     }
 
-    /// serialize function for node types that are trivially copyable
-    std::enable_if_t<std::is_trivially_copyable_v<TNode>, void> serialize(const std::string& filename) const
+    /// immutable copy in compressed sparse row layout for fast traversals, without removed edges and with the edges
+    /// of every node sorted by target
+    FrozenGraph<TNode> freeze() const
     {
-        std::ofstream file(filename, std::ofstream::out|std::ofstream::trunc|std::ofstream::binary);
-        // 1. write the number of nodes
         const size_t num_nodes = size();
-        file.write(reinterpret_cast<const char*>(&num_nodes), sizeof(num_nodes));
-        // 2. write the node data
-        file.write(reinterpret_cast<const char*>(this->data()), static_cast<std::streamsize>(sizeof(TNode)*num_nodes));
-        // 3. write the edge data
-        // 3.1. loop over the nodes and write the edges per node
-        for (size_t i=0; i<num_nodes; ++i) {
-            const auto& edges = get_edges_starting_at(static_cast<uint32_t>(i));
-            // 3.2 write the number of edges for this node
-            const size_t num_edges = edges.size();
-            file.write(reinterpret_cast<const char*>(&num_edges), sizeof(num_edges));
-            // 3.3 loop over the edges
-            for (const auto& [to, weight] : edges) {
-                // make sure the types match our expectations (we don't want to just write arbitrary binary data)
-                static_assert(std::is_same_v<decltype(to), const uint32_t>, "edge target needs to be an uint32_t");
-                static_assert(std::is_same_v<decltype(weight), const float>, "edge weight needs to be a float");
-
-                // 3.4 store the outgoing link and its weight
-                file.write(reinterpret_cast<const char*>(&to), sizeof(to));
-                file.write(reinterpret_cast<const char*>(&weight), sizeof(weight));
+        for (size_t i=num_nodes; i<edges.size(); ++i)
+            if (edges[i].size() > tombstones[i])
+                throw std::logic_error("edges start at a node that does not exist");
+        typename FrozenGraph<TNode>::Storage storage;
+        storage.nodes.assign(cbegin(), cend());
+        storage.offsets.resize(num_nodes+1, 0);
+        for (size_t i=0; i<std::min(num_nodes, edges.size()); ++i)
+            storage.offsets[i+1] = edges[i].size()-tombstones[i];
+        for (size_t i=0; i<num_nodes; ++i)
+            storage.offsets[i+1] += storage.offsets[i];
+        storage.targets.reserve(storage.offsets.back());
+        storage.weights.reserve(storage.offsets.back());
+        std::vector<std::pair<uint32_t, float>> row;
+        for (size_t i=0; i<std::min(num_nodes, edges.size()); ++i) {
+            row.clear();
+            std::copy_if(edges[i].begin(), edges[i].end(), std::back_inserter(row), [](const auto& edge) { return !is_removed(edge); });
+            if (!sorted_rows())
+                std::sort(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            for (const auto& [to, weight] : row) {
+                storage.targets.push_back(to);
+                storage.weights.push_back(weight);
             }
         }
+        return FrozenGraph<TNode>(std::move(storage));
+    }
 
-        file.close();
+    /// immutable copy with compressed edges (see CompressedGraph), the same graph as freeze()
+    CompressedGraph<TNode> compress() const
+    {
+        return CompressedGraph<TNode>(freeze());
+    }
+
+    /// serialize function for node types that are trivially copyable, writes the file format of graph_file.h
+    /// (removed edges are skipped, the edges of every node are sorted by target)
+    std::enable_if_t<std::is_trivially_copyable_v<TNode>, void> serialize(const std::string& filename, bool checksum=true) const
+    {
+        const detail::GraphFileHeader header = detail::GraphFileHeader::layout(sizeof(TNode), size(), count_edges(size()), checksum);
+        detail::GraphFileWriter writer(filename, header);
+        // 1. the node data as one block
+        writer.write(this->data(), sizeof(TNode)*size());
+        // 2. the edges as compressed sparse rows
+        write_edges(writer, header);
+        writer.finish();
+    }
+    /// read-only view of a serialized graph backed by the mapped file, opened in constant time (see FrozenGraph::open_mapped)
+    static FrozenGraph<TNode> open_mapped(const std::string& filename, bool verify_checksum=false)
+    {
+        return FrozenGraph<TNode>::open_mapped(filename, verify_checksum);
     }
     /// deserialize function for node types that are trivially copyable
     /// returns derived type (if any) provided via CRTP
@@ -93,36 +249,14 @@ public:
     deserialize(const std::string& filename)
     {
         DerivedType graph;
-        std::fstream file(filename, std::fstream::in|std::fstream::trunc|std::ifstream::binary);
-
-        file.seekg(0);
-        // const long num_nodes = static_cast<long>(graph.size());
-        // file.read(reinterpret_cast<char *>(graph.size()), sizeof(num_nodes));
-        // // 2. write the node data
-        // file.seekg(num_nodes);
-        // long node_data_le = static_cast<std::streamsize>(sizeof(TNode)* static_cast<unsigned long>(num_nodes));
-        // file.read(reinterpret_cast<char *>(graph.data()), node_data_le);
-        // file.seekg(node_data_le+1);
-
-        size_t num_nodes = graph.size();
-        file.read(reinterpret_cast<char*>(graph.size()), sizeof(num_nodes));
-        file.read(reinterpret_cast<char*>(graph.data()), static_cast<std::streamsize>(sizeof(TNode)*num_nodes));
-
-        file.seekg(static_cast<std::streamsize>(sizeof(TNode)*num_nodes)+1);
-
-        for (uint i=0; i<num_nodes; ++i) {
-            size_t num_edges;
-            file.read(reinterpret_cast<char*>(&num_edges), sizeof(num_edges));
-
-            for (uint j = 0; j < num_edges; j++) {
-                uint32_t to;
-                float weight;
-                file.read(reinterpret_cast<char*>(&to), sizeof(to));
-                file.read(reinterpret_cast<char*>(&weight), sizeof(weight));
-                graph.add_edge(i, to, weight);
-            }
-        }
-        file.close();
+        AdjacencyListGraph& base = graph;
+        detail::GraphFileReader reader(filename, sizeof(TNode));
+        const detail::GraphFileHeader& header = reader.get_header();
+        if (header.num_nodes > UINT32_MAX)
+            throw std::runtime_error(filename+" has too many nodes");
+        base.initialize_nodes(static_cast<uint32_t>(header.num_nodes));
+        reader.read(header.nodes_offset, base.data(), sizeof(TNode)*base.size());
+        base.read_edges(reader);
         return graph;
     }
 };
@@ -0,0 +1,262 @@
+#include "compressed_graph.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    void write_varint(std::vector<unsigned char>& bytes, uint32_t value)
+    {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<unsigned char>(value));
+    }
+
+    constexpr size_t max_weight_values = size_t{1} << 16;
+}
+
+detail::CompressedEdges::CompressedEdges(std::span<const uint64_t> offsets, std::span<const uint32_t> targets, std::span<const float> weights)
+    : nodes(offsets.empty() ? 0 : offsets.size()-1), edges(targets.size())
+{
+    if (nodes >= UINT32_MAX || weights.size() != edges || (!offsets.empty() && (offsets.front() != 0 || offsets.back() != edges)))
+        throw std::invalid_argument("inconsistent graph arrays");
+    Storage storage;
+
+    // 1. the targets: degree and gaps of every node, with a sample in front of every sample_interval-th node
+    storage.samples.reserve(nodes/sample_interval+1);
+    storage.bytes.reserve(nodes+edges+edges/2);
+    for (size_t node=0; node<nodes; ++node) {
+        if (node % sample_interval == 0)
+            storage.samples.push_back({storage.bytes.size(), offsets[node]});
+        const uint64_t degree = offsets[node+1]-offsets[node];
+        if (degree > UINT32_MAX)
+            throw std::invalid_argument("too many edges at one node");
+        write_varint(storage.bytes, static_cast<uint32_t>(degree));
+        for (uint64_t e=offsets[node]; e<offsets[node+1]; ++e) {
+            if (e > offsets[node] && targets[e] <= targets[e-1])
+                throw std::invalid_argument("the edges of every node have to be sorted by target without duplicates");
+            write_varint(storage.bytes, e > offsets[node] ? targets[e]-targets[e-1]-1 : targets[e]);
+        }
+    }
+    storage.bytes.shrink_to_fit();
+
+    // 2. the weights: a table of the distinct weights (by their bits, so that e.g. -0 stays -0) if it is small enough
+    std::unordered_map<uint32_t, uint32_t> codes;
+    std::vector<uint32_t> edge_codes;
+    edge_codes.reserve(edges);
+    for (float weight : weights) {
+        const auto [it, inserted] = codes.try_emplace(std::bit_cast<uint32_t>(weight), static_cast<uint32_t>(codes.size()));
+        if (inserted) {
+            if (codes.size() > max_weight_values)
+                break;
+            storage.weight_values.push_back(weight);
+        }
+        edge_codes.push_back(it->second);
+    }
+    if (codes.size() > max_weight_values) {
+        weight_width = 4;
+        storage.weight_values.clear();
+        storage.weight_codes.resize(4*edges);
+        std::memcpy(storage.weight_codes.data(), weights.data(), weights.size_bytes());
+    }
+    else if (codes.size() <= 1) {
+        // a single weight (or no edges at all) needs no codes
+        weight_width = 0;
+        if (storage.weight_values.empty())
+            storage.weight_values.push_back(1.0f);
+    }
+    else if (codes.size() <= 256) {
+        weight_width = 1;
+        storage.weight_codes.assign(edge_codes.begin(), edge_codes.end());
+    }
+    else {
+        weight_width = 2;
+        storage.weight_codes.resize(2*edges);
+        for (size_t e=0; e<edges; ++e) {
+            const auto code = static_cast<uint16_t>(edge_codes[e]);
+            std::memcpy(storage.weight_codes.data()+2*e, &code, sizeof(code));
+        }
+    }
+    storage.weight_values.shrink_to_fit();
+    adopt(std::move(storage));
+}
+
+void detail::CompressedEdges::adopt(Storage&& storage)
+{
+    const auto owner = std::make_shared<const Storage>(std::move(storage));
+    bytes = owner->bytes;
+    samples = owner->samples;
+    weight_codes = owner->weight_codes;
+    weight_values = owner->weight_values;
+    memory = owner;
+}
+
+detail::CompressedFileHeader detail::CompressedEdges::file_header(uint32_t node_size, bool checksum) const
+{
+    CompressedFileHeader header = CompressedFileHeader::layout(node_size, nodes, edges, samples.size(), bytes.size(), weight_width,
+                                                               weight_values.size(), checksum);
+    header.sample_interval = sample_interval;
+    return header;
+}
+
+void detail::CompressedEdges::write(CompressedFileWriter& writer, const CompressedFileHeader& header) const
+{
+    writer.next_block(header.samples_offset);
+    writer.write(samples.data(), samples.size_bytes());
+    writer.next_block(header.bytes_offset);
+    writer.write(bytes.data(), bytes.size_bytes());
+    writer.next_block(header.codes_offset);
+    writer.write(weight_codes.data(), weight_codes.size_bytes());
+    writer.next_block(header.values_offset);
+    writer.write(weight_values.data(), weight_values.size_bytes());
+}
+
+void detail::CompressedEdges::check(const CompressedFileHeader& header, const std::string& filename)
+{
+    // a single weight, or none at all in an empty graph
+    const bool valid_table = header.weight_width == 0 ? header.num_weight_values == 1 || (header.num_weight_values == 0 && header.num_edges == 0)
+        : header.weight_width == 1 ? header.num_weight_values <= 256
+        : header.weight_width == 2 ? header.num_weight_values <= max_weight_values
+        : header.weight_width == 4 && header.num_weight_values == 0;
+    if (header.sample_interval != sample_interval || header.num_nodes >= UINT32_MAX
+            || header.num_samples != (header.num_nodes+sample_interval-1)/sample_interval || !valid_table)
+        throw std::runtime_error(filename+" is corrupt");
+}
+
+detail::CompressedEdges detail::CompressedEdges::read(CompressedFileReader& reader, const std::string& filename)
+{
+    const CompressedFileHeader& header = reader.get_header();
+    check(header, filename);
+    Storage storage;
+    storage.samples.resize(header.num_samples);
+    storage.bytes.resize(header.num_bytes);
+    storage.weight_codes.resize(header.num_edges*header.weight_width);
+    storage.weight_values.resize(header.num_weight_values);
+    reader.read(header.samples_offset, storage.samples.data(), storage.samples.size()*sizeof(Sample));
+    reader.read(header.bytes_offset, storage.bytes.data(), storage.bytes.size());
+    reader.read(header.codes_offset, storage.weight_codes.data(), storage.weight_codes.size());
+    reader.read(header.values_offset, storage.weight_values.data(), storage.weight_values.size()*sizeof(float));
+    reader.finish();
+
+    // the samples must lead into the records and the codes into the table, the records themselves are not decoded
+    for (size_t i=0; i<storage.samples.size(); ++i) {
+        const Sample& sample = storage.samples[i];
+        const Sample previous = i > 0 ? storage.samples[i-1] : Sample{0, 0};
+        if ((i == 0 && (sample.position != 0 || sample.first_edge != 0)) || sample.position < previous.position
+                || sample.first_edge < previous.first_edge || sample.position >= header.num_bytes || sample.first_edge > header.num_edges)
+            throw std::runtime_error(filename+" is corrupt");
+    }
+    if (header.weight_width == 1 || header.weight_width == 2)
+        for (uint64_t e=0; e<header.num_edges; ++e) {
+            uint16_t code = storage.weight_codes[header.weight_width*e];
+            if (header.weight_width == 2)
+                std::memcpy(&code, storage.weight_codes.data()+2*e, sizeof(code));
+            if (code >= header.num_weight_values)
+                throw std::runtime_error(filename+" is corrupt");
+        }
+
+    CompressedEdges result;
+    result.nodes = header.num_nodes;
+    result.edges = header.num_edges;
+    result.weight_width = header.weight_width;
+    result.adopt(std::move(storage));
+    return result;
+}
+
+detail::CompressedEdges detail::CompressedEdges::view(const CompressedFileHeader& header, const unsigned char* data, std::shared_ptr<const void> owner, const std::string& filename)
+{
+    check(header, filename);
+    CompressedEdges result;
+    result.nodes = header.num_nodes;
+    result.edges = header.num_edges;
+    result.weight_width = header.weight_width;
+    result.bytes = std::span(data+header.bytes_offset, header.num_bytes);
+    result.samples = std::span(reinterpret_cast<const Sample*>(data+header.samples_offset), header.num_samples);
+    result.weight_codes = std::span(data+header.codes_offset, header.num_edges*header.weight_width);
+    result.weight_values = std::span(reinterpret_cast<const float*>(data+header.values_offset), header.num_weight_values);
+    result.memory = std::move(owner);
+    return result;
+}
+
+size_t detail::CompressedEdges::memory_bytes() const
+{
+    return bytes.size_bytes()+samples.size_bytes()+weight_codes.size_bytes()+weight_values.size_bytes();
+}
+
+std::pair<uint64_t, uint64_t> detail::CompressedEdges::locate(uint32_t node) const
+{
+    const Sample& sample = samples[node/sample_interval];
+    const unsigned char* data = bytes.data()+sample.position;
+    uint64_t edge = sample.first_edge;
+    // skip the records in front of node: the degree, then as many varints, each ending with a byte below 0x80
+    for (uint32_t skip=node % sample_interval; skip>0; --skip) {
+        uint32_t degree = read_varint(data);
+        edge += degree;
+        // eight bytes at once, they contain at most eight of the varints
+        for (; degree >= 8; data += 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            degree -= static_cast<uint32_t>(std::popcount(~word & UINT64_C(0x8080808080808080)));
+        }
+        for (; degree > 0; ++data)
+            if (*data < 0x80)
+                --degree;
+    }
+    return {static_cast<uint64_t>(data-bytes.data()), edge};
+}
+
+uint32_t detail::CompressedEdges::degree(uint32_t node) const
+{
+    if (node >= nodes)
+        return 0;
+    const unsigned char* data = bytes.data()+locate(node).first;
+    return read_varint(data);
+}
+
+std::optional<float> detail::CompressedEdges::find_edge(uint32_t from, uint32_t to) const
+{
+    if (from >= nodes)
+        return std::optional<float>{};
+    const auto [position, first_edge] = locate(from);
+    const unsigned char* data = bytes.data()+position;
+    const uint32_t degree = read_varint(data);
+    uint32_t target = 0;
+    for (uint32_t i=0; i<degree; ++i) {
+        target += read_varint(data)+(i > 0 ? 1 : 0);
+        // the targets increase, so the edge cannot come later
+        if (target >= to)
+            return target == to ? std::optional<float>(weight(first_edge+i)) : std::optional<float>{};
+    }
+    return std::optional<float>{};
+}
+
+float detail::CompressedEdges::weight(uint64_t edge) const
+{
+    switch (weight_width) {
+        case 0:
+            return weight_values[0];
+        case 1:
+            return weight_values[weight_codes[edge]];
+        case 2: {
+            uint16_t code;
+            std::memcpy(&code, weight_codes.data()+2*edge, sizeof(code));
+            return weight_values[code];
+        }
+        default: {
+            float value;
+            std::memcpy(&value, weight_codes.data()+4*edge, sizeof(value));
+            return value;
+        }
+    }
+}
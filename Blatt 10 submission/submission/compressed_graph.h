@@ -0,0 +1,296 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "frozen_graph.h"
+#include "graph_file.h"
+
+namespace detail {
+
+    /// The edges of a graph in a compressed byte stream. The record of a node is its degree followed by its targets in
+    /// increasing order, the first one as it is and every further one as the gap to its predecessor minus one, all as
+    /// varints (7 bits per byte, the high bit marks that more bytes follow). The weights are a separate stream with
+    /// one code per edge: if the graph has few distinct weights (at most 65536, e.g. integer or unit weights), the code
+    /// is the index of the weight in a table, of 0, 1 or 2 bytes; otherwise the weight itself (4 bytes).
+    ///
+    /// Every sample_interval-th node has a sample with the position of its record and of its first edge, the records
+    /// of the following nodes are found by skipping over the records in between.
+    ///
+    /// Like FrozenGraph, the edges only hold spans over their arrays together with a shared owner of the memory, which
+    /// is either their own or a mapped file (see graph_file.h for the file format).
+    class CompressedEdges {
+    public:
+        static constexpr uint32_t sample_interval = 16;
+
+        CompressedEdges() = default;
+        /// compresses edges given as compressed sparse rows with the edges of every node sorted by target
+        CompressedEdges(std::span<const uint64_t> offsets, std::span<const uint32_t> targets, std::span<const float> weights);
+
+        /// header of a file with these edges and nodes of node_size bytes
+        CompressedFileHeader file_header(uint32_t node_size, bool checksum) const;
+        /// writes the blocks behind the nodes
+        void write(CompressedFileWriter& writer, const CompressedFileHeader& header) const;
+        /// reads the blocks behind the nodes into arrays owned by the edges and finishes the reader; throws
+        /// std::runtime_error if they are inconsistent
+        static CompressedEdges read(CompressedFileReader& reader, const std::string& filename);
+        /// view over the blocks of a mapped file that owner keeps alive, data is the start of the file; only the header
+        /// is checked
+        static CompressedEdges view(const CompressedFileHeader& header, const unsigned char* data, std::shared_ptr<const void> owner, const std::string& filename);
+
+        size_t num_nodes() const { return nodes; }
+        size_t num_edges() const { return edges; }
+        size_t memory_bytes() const;
+
+        /// calls visit(target, weight) for every edge of node in order of the targets
+        template <typename Visitor>
+        void for_each_edge(uint32_t node, Visitor&& visit) const {
+            if (node >= nodes)
+                return;
+            const auto [position, first_edge] = locate(node);
+            const unsigned char* data = bytes.data()+position;
+            dispatch([&](auto width) {
+                const unsigned char* codes = weight_codes.data()+width*first_edge;
+                decode<width>(data, codes, visit);
+            });
+        }
+
+        /// calls visit(from, to, weight) for all edges, ordered by from and to; decodes the records one after the
+        /// other without locating them
+        template <typename Visitor>
+        void for_each_edge(Visitor&& visit) const {
+            dispatch([&](auto width) {
+                const unsigned char* data = bytes.data();
+                const unsigned char* codes = weight_codes.data();
+                for (uint32_t from=0; from<nodes; ++from)
+                    decode<width>(data, codes, [&](uint32_t to, float weight) { visit(from, to, weight); });
+            });
+        }
+
+        uint32_t degree(uint32_t node) const;
+        /// the weight of the edge from -> to; decodes the targets only up to the first one that is not below to
+        std::optional<float> find_edge(uint32_t from, uint32_t to) const;
+
+    private:
+        struct Sample {
+            uint64_t position;
+            uint64_t first_edge;
+        };
+        static_assert(sizeof(Sample) == 2*sizeof(uint64_t), "the samples are part of the file format");
+
+        struct Storage {
+            std::vector<unsigned char> bytes;
+            std::vector<Sample> samples;
+            std::vector<unsigned char> weight_codes;
+            std::vector<float> weight_values;
+        };
+        /// takes over the arrays of storage
+        void adopt(Storage&& storage);
+        /// throws std::runtime_error unless the header describes edges that this class can decode
+        static void check(const CompressedFileHeader& header, const std::string& filename);
+
+        static uint32_t read_varint(const unsigned char*& data) {
+            uint32_t value = *data++;
+            if (value < 0x80)
+                return value;
+            value &= 0x7F;
+            for (unsigned shift=7;; shift+=7) {
+                const uint32_t byte = *data++;
+                value |= (byte & 0x7F) << shift;
+                if (byte < 0x80)
+                    return value;
+            }
+        }
+
+        /// calls f with the weight width as a compile-time constant, so that it is not checked for every edge
+        template <typename F>
+        void dispatch(F&& f) const {
+            switch (weight_width) {
+                case 0: f(std::integral_constant<unsigned, 0>{}); break;
+                case 1: f(std::integral_constant<unsigned, 1>{}); break;
+                case 2: f(std::integral_constant<unsigned, 2>{}); break;
+                default: f(std::integral_constant<unsigned, 4>{}); break;
+            }
+        }
+
+        /// decodes the record at data with the weight codes at codes, both are advanced behind it
+        template <unsigned width, typename Visitor>
+        void decode(const unsigned char*& data, const unsigned char*& codes, Visitor&& visit) const {
+            const uint32_t degree = read_varint(data);
+            uint32_t target = 0;
+            for (uint32_t i=0; i<degree; ++i, codes+=width) {
+                target += read_varint(data)+(i > 0 ? 1 : 0);
+                if constexpr (width == 0)
+                    visit(target, weight_values[0]);
+                else if constexpr (width == 1)
+                    visit(target, weight_values[*codes]);
+                else if constexpr (width == 2) {
+                    uint16_t code;
+                    std::memcpy(&code, codes, sizeof(code));
+                    visit(target, weight_values[code]);
+                }
+                else {
+                    float weight;
+                    std::memcpy(&weight, codes, sizeof(weight));
+                    visit(target, weight);
+                }
+            }
+        }
+
+        /// the weight of an edge by its index, for single lookups
+        float weight(uint64_t edge) const;
+
+        /// position of the record of node and index of its first edge
+        std::pair<uint64_t, uint64_t> locate(uint32_t node) const;
+
+        size_t nodes = 0;
+        size_t edges = 0;
+        std::span<const unsigned char> bytes;
+        std::span<const Sample> samples;
+        /// bytes per weight code (0, 1, 2 or 4), the codes index weight_values unless the width is 4
+        unsigned weight_width = 0;
+        std::span<const unsigned char> weight_codes;
+        std::span<const float> weight_values;
+        std::shared_ptr<const void> memory;
+    };
+}
+
+/// reusable memory for the edges of a node decoded by CompressedGraph::get_edges_starting_at
+struct EdgeBuffer {
+    std::vector<uint32_t> targets;
+    std::vector<float> weights;
+};
+
+/// Immutable graph like FrozenGraph, with the edges compressed (see detail::CompressedEdges): typically a few bytes
+/// per edge instead of twelve, for graphs that would not fit into memory otherwise and for archival. The edges of a
+/// node are decoded on access, either into a buffer (get_edges_starting_at) or directly into a visitor
+/// (for_each_edge), which is the fastest way to traverse the graph. Created by AdjacencyListGraph::compress().
+///
+/// The size depends mostly on the weights: on graphs with local edges, the compressed graph is about 5x smaller than
+/// the frozen one with unit weights and 3x with small integer weights, but only about 1.6x with arbitrary float
+/// weights, which are stored as they are.
+///
+/// serialize writes the compressed arrays as they are (see graph_file.h), so deserialize and open_mapped do not
+/// compress again and open_mapped uses the file in place.
+template <typename TNode>
+class CompressedGraph {
+public:
+    CompressedGraph() = default;
+
+    explicit CompressedGraph(const FrozenGraph<TNode>& graph)
+        : edges(graph.get_offsets(), graph.get_targets(), graph.get_weights())
+    {
+        auto owner = std::make_shared<const std::vector<TNode>>(graph.begin(), graph.end());
+        nodes = *owner;
+        memory = std::move(owner);
+    }
+
+    size_t size() const { return nodes.size(); }
+    size_t num_edges() const { return edges.num_edges(); }
+    /// memory used by the nodes and the compressed edges
+    size_t memory_bytes() const { return nodes.size_bytes()+edges.memory_bytes(); }
+
+    const TNode& operator[](size_t i) const { return nodes[i]; }
+    const TNode& at(size_t i) const {
+        if (i >= nodes.size())
+            throw std::out_of_range("node does not exist");
+        return nodes[i];
+    }
+    auto begin() const { return nodes.begin(); }
+    auto end() const { return nodes.end(); }
+    auto cbegin() const { return nodes.begin(); }
+    auto cend() const { return nodes.end(); }
+
+    uint32_t degree(uint32_t node) const { return edges.degree(node); }
+
+    /// calls visit(target, weight) for every edge of node in order of the targets
+    template <typename Visitor>
+    void for_each_edge(uint32_t node, Visitor&& visit) const { edges.for_each_edge(node, std::forward<Visitor>(visit)); }
+
+    /// calls visit(from, to, weight) for all edges, ordered by from and to; much faster than visiting the nodes one
+    /// by one
+    template <typename Visitor>
+    void for_each_edge(Visitor&& visit) const { edges.for_each_edge(std::forward<Visitor>(visit)); }
+
+    /// decodes the edges of node into buffer; the range is valid until the buffer is used again
+    EdgeRange get_edges_starting_at(uint32_t node, EdgeBuffer& buffer) const {
+        buffer.targets.clear();
+        buffer.weights.clear();
+        edges.for_each_edge(node, [&](uint32_t to, float weight) {
+            buffer.targets.push_back(to);
+            buffer.weights.push_back(weight);
+        });
+        return {buffer.targets, buffer.weights};
+    }
+
+    std::optional<float> get_edge(uint32_t from, uint32_t to) const { return edges.find_edge(from, to); }
+
+    /// the graph with uncompressed edges
+    FrozenGraph<TNode> decompress() const {
+        typename FrozenGraph<TNode>::Storage storage;
+        storage.nodes.assign(nodes.begin(), nodes.end());
+        storage.offsets.reserve(nodes.size()+1);
+        storage.offsets.push_back(0);
+        storage.targets.reserve(num_edges());
+        storage.weights.reserve(num_edges());
+        for (uint32_t node=0; node<nodes.size(); ++node)
+            storage.offsets.push_back(storage.offsets.back()+edges.degree(node));
+        edges.for_each_edge([&](uint32_t, uint32_t to, float weight) {
+            storage.targets.push_back(to);
+            storage.weights.push_back(weight);
+        });
+        return FrozenGraph<TNode>(std::move(storage));
+    }
+
+    /// writes the nodes and the compressed edges in the compressed file format of graph_file.h
+    std::enable_if_t<std::is_trivially_copyable_v<TNode>, void> serialize(const std::string& filename, bool checksum=true) const
+    {
+        const detail::CompressedFileHeader header = edges.file_header(sizeof(TNode), checksum);
+        detail::CompressedFileWriter writer(filename, header);
+        writer.write(nodes.data(), nodes.size_bytes());
+        edges.write(writer, header);
+        writer.finish();
+    }
+
+    /// Read-only view of a file written by serialize that uses the arrays of the file in place, like
+    /// FrozenGraph::open_mapped: apart from the header, the contents are trusted unless verify_checksum is set.
+    static std::enable_if_t<std::is_trivially_copyable_v<TNode>, CompressedGraph> open_mapped(const std::string& filename, bool verify_checksum=false)
+    {
+        static_assert(alignof(TNode) <= detail::CompressedFileHeader::alignment, "the blocks of the file are not aligned for the node type");
+        auto file = std::make_shared<const detail::MappedFile>(filename);
+        const auto header = detail::check_mapped<detail::CompressedFileHeader>(*file, sizeof(TNode), verify_checksum, filename);
+        const std::span<const TNode> node_data(reinterpret_cast<const TNode*>(file->data()+header.nodes_offset), header.num_nodes);
+        detail::CompressedEdges edges = detail::CompressedEdges::view(header, file->data(), file, filename);
+        return CompressedGraph(node_data, std::move(edges), std::move(file));
+    }
+
+    /// reads a file written by serialize into arrays owned by the graph
+    static std::enable_if_t<std::is_trivially_copyable_v<TNode>, CompressedGraph> deserialize(const std::string& filename)
+    {
+        detail::CompressedFileReader reader(filename, sizeof(TNode));
+        const detail::CompressedFileHeader& header = reader.get_header();
+        auto node_data = std::make_shared<std::vector<TNode>>(header.num_nodes);
+        reader.read(header.nodes_offset, node_data->data(), node_data->size()*sizeof(TNode));
+        detail::CompressedEdges edges = detail::CompressedEdges::read(reader, filename);
+        const std::span<const TNode> node_span(*node_data);
+        return CompressedGraph(node_span, std::move(edges), std::move(node_data));
+    }
+
+private:
+    CompressedGraph(std::span<const TNode> n, detail::CompressedEdges&& e, std::shared_ptr<const void> owner)
+        : nodes(n), edges(std::move(e)), memory(std::move(owner)) {}
+
+    std::span<const TNode> nodes;
+    detail::CompressedEdges edges;
+    /// owner of the nodes
+    std::shared_ptr<const void> memory;
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "graph_file.h"
+
+/// the outgoing edges of a node in a FrozenGraph, sorted by target; iterating yields (target, weight) pairs like the
+/// lists of AdjacencyListGraph
+struct EdgeRange {
+    std::span<const uint32_t> targets;
+    std::span<const float> weights;
+
+    class iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::pair<uint32_t, float>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        iterator() = default;
+        iterator(const uint32_t* t, const float* w) : target(t), weight(w) {}
+
+        value_type operator*() const { return {*target, *weight}; }
+        value_type operator[](difference_type i) const { return {target[i], weight[i]}; }
+        iterator& operator++() { ++target; ++weight; return *this; }
+        iterator operator++(int) { iterator old = *this; ++*this; return old; }
+        iterator& operator--() { --target; --weight; return *this; }
+        iterator operator--(int) { iterator old = *this; --*this; return old; }
+        iterator& operator+=(difference_type n) { target += n; weight += n; return *this; }
+        iterator& operator-=(difference_type n) { target -= n; weight -= n; return *this; }
+        iterator operator+(difference_type n) const { return iterator(target+n, weight+n); }
+        friend iterator operator+(difference_type n, const iterator& it) { return it+n; }
+        iterator operator-(difference_type n) const { return iterator(target-n, weight-n); }
+        difference_type operator-(const iterator& other) const { return target-other.target; }
+        bool operator==(const iterator& other) const { return target == other.target; }
+        auto operator<=>(const iterator& other) const { return target <=> other.target; }
+
+    private:
+        const uint32_t* target = nullptr;
+        const float* weight = nullptr;
+    };
+
+    size_t size() const { return targets.size(); }
+    bool empty() const { return targets.empty(); }
+    std::pair<uint32_t, float> operator[](size_t i) const { return {targets[i], weights[i]}; }
+    iterator begin() const { return iterator(targets.data(), weights.data()); }
+    iterator end() const { return iterator(targets.data()+targets.size(), weights.data()+weights.size()); }
+};
+
+/// Immutable graph in compressed sparse row layout: the edges of node v are at [offsets[v], offsets[v+1]) of the
+/// targets and weights arrays (structure of arrays), sorted by target. Created by AdjacencyListGraph::freeze().
+///
+/// The graph only holds spans over its arrays together with a shared owner of the memory behind them, so copies are
+/// cheap and share the data. It offers the read-only interface of AdjacencyListGraph (size, operator[], get_edge,
+/// get_edges_starting_at, serialize), algorithms written as templates over the graph type work with both.
+template <typename TNode>
+class FrozenGraph {
+public:
+    /// arrays owned by the graph
+    struct Storage {
+        std::vector<TNode> nodes;
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> targets;
+        std::vector<float> weights;
+    };
+
+    FrozenGraph() = default;
+
+    explicit FrozenGraph(Storage&& storage) {
+        if (storage.offsets.size() != storage.nodes.size()+1 || storage.targets.size() != storage.weights.size()
+                || storage.offsets.back() != storage.targets.size())
+            throw std::invalid_argument("inconsistent graph arrays");
+        const auto owner = std::make_shared<const Storage>(std::move(storage));
+        nodes = owner->nodes;
+        offsets = owner->offsets;
+        targets = owner->targets;
+        weights = owner->weights;
+        memory = owner;
+    }
+
+    /// view over arrays in memory that owner keeps alive
+    FrozenGraph(std::span<const TNode> n, std::span<const uint64_t> o, std::span<const uint32_t> t, std::span<const float> w, std::shared_ptr<const void> owner)
+        : nodes(n), offsets(o), targets(t), weights(w), memory(std::move(owner)) {}
+
+    size_t size() const { return nodes.size(); }
+    size_t num_edges() const { return targets.size(); }
+
+    const TNode& operator[](size_t i) const { return nodes[i]; }
+    const TNode& at(size_t i) const {
+        if (i >= nodes.size())
+            throw std::out_of_range("node does not exist");
+        return nodes[i];
+    }
+    auto begin() const { return nodes.begin(); }
+    auto end() const { return nodes.end(); }
+    auto cbegin() const { return nodes.begin(); }
+    auto cend() const { return nodes.end(); }
+
+    EdgeRange get_edges_starting_at(uint32_t node) const {
+        if (node >= nodes.size())
+            return {};
+        const size_t first = offsets[node];
+        const size_t count = offsets[node+1]-first;
+        return {targets.subspan(first, count), weights.subspan(first, count)};
+    }
+
+    std::optional<float> get_edge(uint32_t from, uint32_t to) const {
+        const EdgeRange edges = get_edges_starting_at(from);
+        const auto it = std::lower_bound(edges.targets.begin(), edges.targets.end(), to);
+        if (it == edges.targets.end() || *it != to)
+            return std::optional<float>{};
+        return edges.weights[static_cast<size_t>(it-edges.targets.begin())];
+    }
+
+    /// the arrays of the compressed sparse rows
+    std::span<const TNode> get_nodes() const { return nodes; }
+    std::span<const uint64_t> get_offsets() const { return offsets; }
+    std::span<const uint32_t> get_targets() const { return targets; }
+    std::span<const float> get_weights() const { return weights; }
+
+    /// writes the same file as AdjacencyListGraph::serialize, every array as one block
+    std::enable_if_t<std::is_trivially_copyable_v<TNode>, void> serialize(const std::string& filename, bool checksum=true) const
+    {
+        const detail::GraphFileHeader header = detail::GraphFileHeader::layout(sizeof(TNode), size(), num_edges(), checksum);
+        detail::GraphFileWriter writer(filename, header);
+        writer.write(nodes.data(), nodes.size_bytes());
+        writer.next_block(header.offsets_offset);
+        if (offsets.empty()) {
+            const uint64_t zero = 0;
+            writer.write(&zero, sizeof(zero));
+        }
+        else
+            writer.write(offsets.data(), offsets.size_bytes());
+        writer.next_block(header.targets_offset);
+        writer.write(targets.data(), targets.size_bytes());
+        writer.next_block(header.weights_offset);
+        writer.write(weights.data(), weights.size_bytes());
+        writer.finish();
+    }
+
+    /// Read-only view of a file written by serialize (of either graph) that uses the arrays of the file in place:
+    /// the file is mapped into memory, nothing is parsed or copied, and pages are only loaded when they are accessed.
+    /// Apart from the header, the contents are trusted unless verify_checksum is set, which reads the whole file once.
+    static std::enable_if_t<std::is_trivially_copyable_v<TNode>, FrozenGraph> open_mapped(const std::string& filename, bool verify_checksum=false)
+    {
+        static_assert(alignof(TNode) <= detail::GraphFileHeader::alignment, "the blocks of the file are not aligned for the node type");
+        auto file = std::make_shared<const detail::MappedFile>(filename);
+        const detail::GraphFileHeader header = detail::check_mapped(*file, sizeof(TNode), verify_checksum, filename);
+        const unsigned char* data = file->data();
+        const auto block = [&](uint64_t offset) { return data+offset; };
+        return FrozenGraph(std::span(reinterpret_cast<const TNode*>(block(header.nodes_offset)), header.num_nodes),
+                           std::span(reinterpret_cast<const uint64_t*>(block(header.offsets_offset)), header.num_nodes+1),
+                           std::span(reinterpret_cast<const uint32_t*>(block(header.targets_offset)), header.num_edges),
+                           std::span(reinterpret_cast<const float*>(block(header.weights_offset)), header.num_edges),
+                           std::move(file));
+    }
+
+    /// reads a file written by serialize (of either graph) into arrays owned by the graph
+    static std::enable_if_t<std::is_trivially_copyable_v<TNode>, FrozenGraph> deserialize(const std::string& filename)
+    {
+        detail::GraphFileReader reader(filename, sizeof(TNode));
+        const detail::GraphFileHeader& header = reader.get_header();
+        Storage storage;
+        storage.nodes.resize(header.num_nodes);
+        storage.offsets.resize(header.num_nodes+1);
+        storage.targets.resize(header.num_edges);
+        storage.weights.resize(header.num_edges);
+        reader.read(header.nodes_offset, storage.nodes.data(), storage.nodes.size()*sizeof(TNode));
+        reader.read(header.offsets_offset, storage.offsets.data(), storage.offsets.size()*sizeof(uint64_t));
+        reader.read(header.targets_offset, storage.targets.data(), storage.targets.size()*sizeof(uint32_t));
+        reader.read(header.weights_offset, storage.weights.data(), storage.weights.size()*sizeof(float));
+        reader.finish();
+        if (storage.offsets.front() != 0 || !std::is_sorted(storage.offsets.begin(), storage.offsets.end()))
+            throw std::runtime_error(filename+" is corrupt");
+        return FrozenGraph(std::move(storage));
+    }
+
+private:
+    std::span<const TNode> nodes;
+    std::span<const uint64_t> offsets;
+    std::span<const uint32_t> targets;
+    std::span<const float> weights;
+    std::shared_ptr<const void> memory;
+};
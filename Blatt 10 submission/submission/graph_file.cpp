@@ -0,0 +1,291 @@
+#include "graph_file.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    uint64_t align(uint64_t offset)
+    {
+        constexpr uint64_t alignment = detail::GraphFileHeader::alignment;
+        return (offset+alignment-1)/alignment*alignment;
+    }
+
+    /// tables for slicing-by-8: table[k][b] is the CRC of byte b followed by k zero bytes
+    using CrcTables = std::array<std::array<uint32_t, 256>, 8>;
+
+    CrcTables make_crc_tables()
+    {
+        CrcTables tables {};
+        for (uint32_t b=0; b<256; ++b) {
+            uint32_t crc = b;
+            for (int bit=0; bit<8; ++bit)
+                crc = (crc >> 1)^((crc & 1) ? 0xEDB88320u : 0u);
+            tables[0][b] = crc;
+        }
+        for (size_t k=1; k<8; ++k)
+            for (size_t b=0; b<256; ++b)
+                tables[k][b] = (tables[k-1][b] >> 8)^tables[0][tables[k-1][b] & 0xFF];
+        return tables;
+    }
+
+    constexpr size_t chunk_size = 1 << 20;
+}
+
+detail::GraphFileHeader detail::GraphFileHeader::layout(uint32_t node_size, uint64_t num_nodes, uint64_t num_edges, bool checksum)
+{
+    GraphFileHeader header {};
+    std::copy(std::begin(file_magic), std::end(file_magic), header.magic);
+    header.version = current_version;
+    header.byte_order = byte_order_mark;
+    header.node_size = node_size;
+    header.flags = checksum ? has_checksum : 0;
+    header.num_nodes = num_nodes;
+    header.num_edges = num_edges;
+    header.nodes_offset = align(sizeof(GraphFileHeader));
+    header.offsets_offset = align(header.nodes_offset+num_nodes*node_size);
+    header.targets_offset = align(header.offsets_offset+(num_nodes+1)*sizeof(uint64_t));
+    header.weights_offset = align(header.targets_offset+num_edges*sizeof(uint32_t));
+    header.file_size = header.weights_offset+num_edges*sizeof(float);
+    return header;
+}
+
+void detail::GraphFileHeader::check(uint32_t expected_node_size, uint64_t actual_file_size, const std::string& filename) const
+{
+    if (!std::equal(std::begin(file_magic), std::end(file_magic), magic))
+        throw std::runtime_error(filename+" is not "+format_name);
+    // before any other number, which would be byte-swapped as well
+    if (byte_order != byte_order_mark)
+        throw std::runtime_error(filename+" was written on a machine with a different byte order");
+    if (version != current_version)
+        throw std::runtime_error(filename+" has the unsupported format version "+std::to_string(version));
+    if (node_size != expected_node_size)
+        throw std::runtime_error(filename+" contains nodes of "+std::to_string(node_size)+" bytes instead of "+std::to_string(expected_node_size));
+    const GraphFileHeader expected = layout(node_size, num_nodes, num_edges, flags & has_checksum);
+    if (nodes_offset != expected.nodes_offset || offsets_offset != expected.offsets_offset || targets_offset != expected.targets_offset
+            || weights_offset != expected.weights_offset || file_size != expected.file_size)
+        throw std::runtime_error(filename+" has an invalid block layout");
+    if (actual_file_size < file_size)
+        throw std::runtime_error(filename+" is truncated");
+}
+
+detail::CompressedFileHeader detail::CompressedFileHeader::layout(uint32_t node_size, uint64_t num_nodes, uint64_t num_edges, uint64_t num_samples,
+                                                                  uint64_t num_bytes, uint32_t weight_width, uint64_t num_weight_values, bool checksum)
+{
+    CompressedFileHeader header {};
+    std::copy(std::begin(file_magic), std::end(file_magic), header.magic);
+    header.version = current_version;
+    header.byte_order = byte_order_mark;
+    header.node_size = node_size;
+    header.flags = checksum ? has_checksum : 0;
+    header.num_nodes = num_nodes;
+    header.num_edges = num_edges;
+    header.weight_width = weight_width;
+    header.num_samples = num_samples;
+    header.num_bytes = num_bytes;
+    header.num_weight_values = num_weight_values;
+    header.nodes_offset = align(sizeof(CompressedFileHeader));
+    header.samples_offset = align(header.nodes_offset+num_nodes*node_size);
+    header.bytes_offset = align(header.samples_offset+num_samples*2*sizeof(uint64_t));
+    header.codes_offset = align(header.bytes_offset+num_bytes);
+    header.values_offset = align(header.codes_offset+num_edges*weight_width);
+    header.file_size = header.values_offset+num_weight_values*sizeof(float);
+    return header;
+}
+
+void detail::CompressedFileHeader::check(uint32_t expected_node_size, uint64_t actual_file_size, const std::string& filename) const
+{
+    if (!std::equal(std::begin(file_magic), std::end(file_magic), magic))
+        throw std::runtime_error(filename+" is not "+format_name);
+    if (byte_order != byte_order_mark)
+        throw std::runtime_error(filename+" was written on a machine with a different byte order");
+    if (version != current_version)
+        throw std::runtime_error(filename+" has the unsupported format version "+std::to_string(version));
+    if (node_size != expected_node_size)
+        throw std::runtime_error(filename+" contains nodes of "+std::to_string(node_size)+" bytes instead of "+std::to_string(expected_node_size));
+    // the sizes must not overflow the layout, every block is at most as large as the file
+    if (num_nodes > actual_file_size/std::max<uint64_t>(node_size, 1) || num_edges > actual_file_size || num_samples > actual_file_size
+            || num_bytes > actual_file_size || weight_width > 4 || num_weight_values > actual_file_size)
+        throw std::runtime_error(filename+" has an invalid block layout");
+    const CompressedFileHeader expected = layout(node_size, num_nodes, num_edges, num_samples, num_bytes, weight_width, num_weight_values, flags & has_checksum);
+    if (nodes_offset != expected.nodes_offset || samples_offset != expected.samples_offset || bytes_offset != expected.bytes_offset
+            || codes_offset != expected.codes_offset || values_offset != expected.values_offset || file_size != expected.file_size)
+        throw std::runtime_error(filename+" has an invalid block layout");
+    if (actual_file_size < file_size)
+        throw std::runtime_error(filename+" is truncated");
+}
+
+uint32_t detail::crc32(uint32_t crc, const void* data, size_t size)
+{
+    static const CrcTables tables = make_crc_tables();
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    // eight bytes per step, the table lookups are independent of each other
+    for (; size >= 8; size -= 8, bytes += 8) {
+        uint32_t low, high;
+        std::memcpy(&low, bytes, 4);
+        std::memcpy(&high, bytes+4, 4);
+        low ^= crc;
+        crc = tables[7][low & 0xFF]^tables[6][(low >> 8) & 0xFF]^tables[5][(low >> 16) & 0xFF]^tables[4][low >> 24]
+             ^tables[3][high & 0xFF]^tables[2][(high >> 8) & 0xFF]^tables[1][(high >> 16) & 0xFF]^tables[0][high >> 24];
+    }
+    for (; size > 0; --size, ++bytes)
+        crc = (crc >> 8)^tables[0][(crc ^ *bytes) & 0xFF];
+    return ~crc;
+}
+
+template <typename Header>
+detail::FileWriter<Header>::FileWriter(const std::string& name, const Header& file_header)
+    : filename(name), file(name, std::ofstream::out|std::ofstream::trunc|std::ofstream::binary), header(file_header)
+{
+    if (!file)
+        throw std::runtime_error("cannot open "+filename);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    position = sizeof(header);
+    next_block(header.nodes_offset);
+}
+
+template <typename Header>
+void detail::FileWriter<Header>::write(const void* data, size_t size)
+{
+    if (header.flags & Header::has_checksum)
+        crc = crc32(crc, data, size);
+    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    position += size;
+}
+
+template <typename Header>
+void detail::FileWriter<Header>::next_block(uint64_t offset)
+{
+    static constexpr char zeros[Header::alignment] = {};
+    if (offset < position || offset-position > sizeof(zeros))
+        throw std::logic_error("graph file blocks written out of order");
+    if (position < header.nodes_offset) {
+        // the padding behind the header is not part of the checksum
+        file.write(zeros, static_cast<std::streamsize>(offset-position));
+        position = offset;
+    }
+    else
+        write(zeros, offset-position);
+}
+
+template <typename Header>
+void detail::FileWriter<Header>::finish()
+{
+    if (position != header.file_size)
+        throw std::logic_error("graph file has the wrong size");
+    header.checksum = crc;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (!file)
+        throw std::runtime_error("writing "+filename+" failed");
+}
+
+detail::MappedFile::MappedFile(const std::string& filename)
+{
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("cannot open "+filename);
+    struct stat status {};
+    if (::fstat(fd, &status) != 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot open "+filename);
+    }
+    length = static_cast<size_t>(status.st_size);
+    if (length > 0) {
+        address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            address = nullptr;
+            ::close(fd);
+            throw std::runtime_error("cannot map "+filename);
+        }
+    }
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+}
+
+detail::MappedFile::~MappedFile()
+{
+    if (address)
+        ::munmap(address, length);
+}
+
+template <typename Header>
+Header detail::check_mapped(const MappedFile& file, uint32_t node_size, bool verify_checksum, const std::string& filename)
+{
+    Header header {};
+    if (file.size() < sizeof(header))
+        throw std::runtime_error(filename+" is not "+Header::format_name);
+    std::memcpy(&header, file.data(), sizeof(header));
+    header.check(node_size, file.size(), filename);
+    if (verify_checksum && (header.flags & Header::has_checksum)
+            && crc32(0, file.data()+header.nodes_offset, header.file_size-header.nodes_offset) != header.checksum)
+        throw std::runtime_error(filename+" is corrupt (checksum mismatch)");
+    return header;
+}
+
+template <typename Header>
+detail::FileReader<Header>::FileReader(const std::string& name, uint32_t node_size)
+    : filename(name), file(name, std::ifstream::in|std::ifstream::binary)
+{
+    if (!file)
+        throw std::runtime_error("cannot open "+filename);
+    const uint64_t file_size = std::filesystem::file_size(filename);
+    if (file_size < sizeof(header))
+        throw std::runtime_error(filename+" is not "+Header::format_name);
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    header.check(node_size, file_size, filename);
+    file.seekg(static_cast<std::streamoff>(header.nodes_offset));
+    position = header.nodes_offset;
+}
+
+template <typename Header>
+void detail::FileReader<Header>::read(uint64_t offset, void* data, size_t size)
+{
+    if (offset < position)
+        throw std::logic_error("graph file blocks read out of order");
+    // the padding in front of the block counts for the checksum as well
+    char padding[Header::alignment];
+    while (position < offset)
+        consume(padding, std::min<uint64_t>(offset-position, sizeof(padding)));
+    // in chunks, so that the checksum is computed while the data is still in the cache
+    auto* bytes = static_cast<char*>(data);
+    for (size_t done=0; done<size; done+=chunk_size)
+        consume(bytes+done, std::min(chunk_size, size-done));
+}
+
+template <typename Header>
+void detail::FileReader<Header>::consume(void* data, size_t size)
+{
+    file.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+    if (!file)
+        throw std::runtime_error("reading "+filename+" failed");
+    if (header.flags & Header::has_checksum)
+        crc = crc32(crc, data, size);
+    position += size;
+}
+
+template <typename Header>
+void detail::FileReader<Header>::finish()
+{
+    if ((header.flags & Header::has_checksum) && (position != header.file_size || crc != header.checksum))
+        throw std::runtime_error(filename+" is corrupt (checksum mismatch)");
+    file.close();
+}
+
+template class detail::FileWriter<detail::GraphFileHeader>;
+template class detail::FileWriter<detail::CompressedFileHeader>;
+template class detail::FileReader<detail::GraphFileHeader>;
+template class detail::FileReader<detail::CompressedFileHeader>;
+template detail::GraphFileHeader detail::check_mapped(const MappedFile&, uint32_t, bool, const std::string&);
+template detail::CompressedFileHeader detail::check_mapped(const MappedFile&, uint32_t, bool, const std::string&);
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/// Graph file format, version 2. All numbers are in the byte order of the writing machine, recorded in the header:
+///
+///     header     GraphFileHeader, 88 bytes, padded to 128
+///     nodes      num_nodes * node_size bytes (the node data, e.g. visit counts)
+///     offsets    (num_nodes+1) * uint64_t, the edges of node v are [offsets[v], offsets[v+1])
+///     targets    num_edges * uint32_t
+///     weights    num_edges * float
+///
+/// Every block starts at a multiple of 64 bytes, so a mapped file can be used in place. The optional checksum is the
+/// CRC-32 of everything behind the header. Files of the old format (version 1, without header) start with the number
+/// of nodes instead of the magic and are rejected.
+///
+/// Compressed graphs (CompressedGraph) have a file format of their own, version 1, with the same byte order mark,
+/// alignment and checksum:
+///
+///     header     CompressedFileHeader, 128 bytes
+///     nodes      num_nodes * node_size bytes
+///     samples    num_samples * 2 uint64_t, the position of the record and the first edge of every
+///                sample_interval-th node
+///     records    num_bytes bytes, the varint records of the nodes (degree and gaps between the targets)
+///     codes      num_edges * weight_width bytes, the weight of every edge or its index in the weight table
+///     values     num_weight_values * float, the weight table
+namespace detail {
+
+    struct GraphFileHeader {
+        char magic[8];
+        uint32_t version;
+        /// byte_order_mark as written by the writing machine
+        uint32_t byte_order;
+        uint32_t node_size;
+        uint32_t flags;
+        uint64_t num_nodes;
+        uint64_t num_edges;
+        uint64_t nodes_offset;
+        uint64_t offsets_offset;
+        uint64_t targets_offset;
+        uint64_t weights_offset;
+        uint64_t file_size;
+        uint32_t checksum;
+        uint32_t reserved;
+
+        static constexpr char file_magic[8] = {'A', 'D', 'J', 'G', 'R', 'A', 'P', 'H'};
+        static constexpr uint32_t current_version = 2;
+        static constexpr const char* format_name = "a graph file of version 2 (files of the old format have to be written again)";
+        static constexpr uint32_t byte_order_mark = 0x01020304;
+        static constexpr uint32_t has_checksum = 1;
+        static constexpr uint64_t alignment = 64;
+
+        /// header with the block layout of a graph of the given size
+        static GraphFileHeader layout(uint32_t node_size, uint64_t num_nodes, uint64_t num_edges, bool checksum);
+        /// throws std::runtime_error if the header does not belong to a valid file of the current version with nodes of
+        /// node_size bytes and with the given size
+        void check(uint32_t expected_node_size, uint64_t actual_file_size, const std::string& filename) const;
+    };
+    static_assert(sizeof(GraphFileHeader) == 88, "the header layout is part of the file format");
+
+    struct CompressedFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t node_size;
+        uint32_t flags;
+        uint64_t num_nodes;
+        uint64_t num_edges;
+        uint32_t sample_interval;
+        /// bytes per weight code: 0, 1 or 2 for an index into the weight table, 4 for the weight itself
+        uint32_t weight_width;
+        uint64_t num_samples;
+        uint64_t num_bytes;
+        uint64_t num_weight_values;
+        uint64_t nodes_offset;
+        uint64_t samples_offset;
+        uint64_t bytes_offset;
+        uint64_t codes_offset;
+        uint64_t values_offset;
+        uint64_t file_size;
+        uint32_t checksum;
+        uint32_t reserved;
+
+        static constexpr char file_magic[8] = {'C', 'M', 'P', 'G', 'R', 'A', 'P', 'H'};
+        static constexpr uint32_t current_version = 1;
+        static constexpr const char* format_name = "a compressed graph file of version 1";
+        static constexpr uint32_t byte_order_mark = GraphFileHeader::byte_order_mark;
+        static constexpr uint32_t has_checksum = GraphFileHeader::has_checksum;
+        static constexpr uint64_t alignment = GraphFileHeader::alignment;
+
+        /// header with the block layout of the given sizes; the rest of the header is filled in by the caller
+        static CompressedFileHeader layout(uint32_t node_size, uint64_t num_nodes, uint64_t num_edges, uint64_t num_samples,
+                                           uint64_t num_bytes, uint32_t weight_width, uint64_t num_weight_values, bool checksum);
+        /// as GraphFileHeader::check; the contents of the blocks (sample interval, weight width) are checked by the reader
+        void check(uint32_t expected_node_size, uint64_t actual_file_size, const std::string& filename) const;
+    };
+    static_assert(sizeof(CompressedFileHeader) == 128, "the header layout is part of the file format");
+
+    /// CRC-32 (as in zlib) of data, continuing from crc (0 for the start)
+    uint32_t crc32(uint32_t crc, const void* data, size_t size);
+
+    /// writes the blocks of a graph file (of either format) in order; write() appends to the current block,
+    /// next_block() starts the next one
+    template <typename Header>
+    class FileWriter {
+    public:
+        FileWriter(const std::string& filename, const Header& file_header);
+
+        void write(const void* data, size_t size);
+        /// pads the file to the start of the next block at offset
+        void next_block(uint64_t offset);
+        /// writes the checksum into the header and closes the file
+        void finish();
+
+    private:
+        std::string filename;
+        std::ofstream file;
+        Header header;
+        uint64_t position = 0;
+        uint32_t crc = 0;
+    };
+    using GraphFileWriter = FileWriter<GraphFileHeader>;
+    using CompressedFileWriter = FileWriter<CompressedFileHeader>;
+
+    /// a whole file mapped read-only into memory (POSIX mmap); pages are loaded lazily on first access
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& filename);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const unsigned char* data() const { return static_cast<const unsigned char*>(address); }
+        size_t size() const { return length; }
+
+    private:
+        void* address = nullptr;
+        size_t length = 0;
+    };
+
+    /// the header of a mapped graph file after Header::check; with verify_checksum, the CRC is computed over the whole
+    /// file, which reads every page
+    template <typename Header = GraphFileHeader>
+    Header check_mapped(const MappedFile& file, uint32_t node_size, bool verify_checksum, const std::string& filename);
+
+    /// reads the blocks of a graph file (of either format) in order and verifies the checksum (if any) in finish()
+    template <typename Header>
+    class FileReader {
+    public:
+        FileReader(const std::string& filename, uint32_t node_size);
+
+        const Header& get_header() const { return header; }
+        /// reads size bytes starting at offset, which must not be before the end of the last read
+        void read(uint64_t offset, void* data, size_t size);
+        void finish();
+
+    private:
+        void consume(void* data, size_t size);
+
+        std::string filename;
+        std::ifstream file;
+        Header header;
+        uint64_t position = 0;
+        uint32_t crc = 0;
+    };
+    using GraphFileReader = FileReader<GraphFileHeader>;
+    using CompressedFileReader = FileReader<CompressedFileHeader>;
+}
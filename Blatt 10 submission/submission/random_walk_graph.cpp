@@ -1,6 +1,8 @@
 #include "random_walk_graph.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <fstream>
 #include <ios>
@@ -8,21 +10,217 @@
 #include <random>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 #include <sys/types.h>
 
-void RandomWalkGraph::simulate_random_walk(uint32_t num_steps) {
-    // uint32_t size = this->size();
-    // std::uniform_int_distribution<uint32_t> dice {0, size};
-    // uint32_t start = dice(prng);
-    // float weightSum = 0;
-    // for (size_t i = 0; i < size; i++){
-    //     weightSum += edges[start][i].second;
-    // }
-    // float sum = 0;
-    // for (size_t i=0; i < size; i++){
-
-    // }
- }
+namespace {
+
+    using PhiloxWords = std::array<uint32_t, 4>;
+
+    /// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"): four random words for every
+    /// value of the counter, an independent stream for every key
+    PhiloxWords philox(PhiloxWords counter, std::array<uint32_t, 2> key)
+    {
+        for (int round=0; round<10; ++round) {
+            if (round > 0) {
+                key[0] += 0x9E3779B9u;
+                key[1] += 0xBB67AE85u;
+            }
+            const uint64_t product0 = uint64_t{0xD2511F53u}*counter[0];
+            const uint64_t product1 = uint64_t{0xCD9E8D57u}*counter[2];
+            counter = {static_cast<uint32_t>(product1 >> 32)^counter[1]^key[0], static_cast<uint32_t>(product1),
+                       static_cast<uint32_t>(product0 >> 32)^counter[3]^key[1], static_cast<uint32_t>(product0)};
+        }
+        return counter;
+    }
+
+    /// the random numbers of one walker: the counter is (block, walker, simulation), so no two walkers or simulations
+    /// share numbers and no state has to be handed between threads
+    class WalkerRandom {
+    public:
+        WalkerRandom(uint64_t seed, uint32_t walker, uint64_t simulation)
+            : key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)},
+              counter{0, walker, static_cast<uint32_t>(simulation), static_cast<uint32_t>(simulation >> 32)} {}
+
+        uint32_t next() {
+            if (used == words.size()) {
+                words = philox(counter, key);
+                ++counter[0];
+                used = 0;
+            }
+            return words[used++];
+        }
+        /// uniform in [0, n) by multiply-shift, the bias is below n/2^32
+        uint32_t below(uint32_t n) { return static_cast<uint32_t>((uint64_t{next()}*n) >> 32); }
+        /// uniform in [0, 1)
+        float uniform() { return static_cast<float>(next() >> 8)*0x1p-24f; }
+
+    private:
+        std::array<uint32_t, 2> key;
+        PhiloxWords counter;
+        PhiloxWords words {};
+        size_t used = words.size();
+    };
+
+    constexpr uint32_t walker_block_size = 16;
+    constexpr uint32_t alias_block_size = 1024;
+}
+
+void AliasTables::build(size_t num_nodes, unsigned num_threads, const EdgeSource& edges_of) {
+    if (num_nodes > UINT32_MAX)
+        throw std::length_error("too many nodes for the alias tables");
+    const auto node_count = static_cast<uint32_t>(num_nodes);
+
+    // 1. one slot per edge with a positive weight
+    offsets.assign(num_nodes+1, 0);
+    std::vector<uint32_t> node_targets;
+    std::vector<double> node_weights;
+    for (uint32_t node=0; node<node_count; ++node) {
+        node_targets.clear();
+        node_weights.clear();
+        edges_of(node, node_targets, node_weights);
+        if (std::any_of(node_targets.begin(), node_targets.end(), [=](uint32_t to) { return to >= node_count; }))
+            throw std::logic_error("edges lead to a node that does not exist");
+        offsets[node+1] = offsets[node]+node_targets.size();
+    }
+    slots.resize(offsets.back());
+
+    // 2. the tables of blocks of nodes in parallel, each written into the slots of its node
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::min(num_threads, (node_count+alias_block_size-1)/alias_block_size);
+    std::atomic<uint32_t> next_node {0};
+    std::vector<std::thread> threads;
+    for (unsigned t=0; t<num_threads; ++t) {
+        threads.emplace_back([&] {
+            // the probabilities scaled by the degree (1 on average) and the slots below and above 1
+            std::vector<double> scaled;
+            std::vector<uint32_t> small, large;
+            std::vector<uint32_t> targets;
+            for (uint32_t first = next_node.fetch_add(alias_block_size); first < node_count; first = next_node.fetch_add(alias_block_size)) {
+                for (uint32_t node=first; node<std::min(first+alias_block_size, node_count); ++node) {
+                    Slot* node_slots = slots.data()+offsets[node];
+                    const auto degree = static_cast<uint32_t>(offsets[node+1]-offsets[node]);
+                    if (degree == 0)
+                        continue;
+                    targets.clear();
+                    scaled.clear();
+                    edges_of(node, targets, scaled);
+                    const double total = std::accumulate(scaled.begin(), scaled.end(), 0.0);
+                    small.clear();
+                    large.clear();
+                    for (uint32_t i=0; i<degree; ++i) {
+                        scaled[i] *= degree/total;
+                        (scaled[i] < 1.0 ? small : large).push_back(i);
+                    }
+                    // every small slot is filled up by a large one, which then may become small itself
+                    while (!small.empty() && !large.empty()) {
+                        const uint32_t s = small.back();
+                        small.pop_back();
+                        const uint32_t l = large.back();
+                        node_slots[s] = {static_cast<float>(scaled[s]), targets[s], targets[l]};
+                        scaled[l] -= 1.0-scaled[s];
+                        if (scaled[l] < 1.0) {
+                            large.pop_back();
+                            small.push_back(l);
+                        }
+                    }
+                    // the rest is 1 up to rounding errors
+                    for (const std::vector<uint32_t>* rest : {&small, &large})
+                        for (uint32_t i : *rest)
+                            node_slots[i] = {1.0f, targets[i], targets[i]};
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void simulate_random_walk(const AliasTables& tables, std::span<uint32_t> visits, uint32_t num_steps, uint64_t seed,
+                          uint64_t simulation, const WalkOptions& options) {
+    const auto num_nodes = static_cast<uint32_t>(tables.num_nodes());
+    if (visits.size() != tables.num_nodes())
+        throw std::invalid_argument("the visit counts do not belong to the graph of the alias tables");
+    if (num_steps == 0)
+        return;
+    if (num_nodes == 0)
+        throw std::logic_error("a random walk needs at least one node");
+    if (options.num_walkers == 0)
+        throw std::invalid_argument("a random walk needs at least one walker");
+
+    // the next node after node: a uniformly chosen slot of its alias table and then either its target or its alias,
+    // or a jump if the node has no edges with a positive weight
+    const auto step = [&](uint32_t node, WalkerRandom& random) -> uint32_t {
+        const uint64_t first = tables.offsets[node];
+        const auto degree = static_cast<uint32_t>(tables.offsets[node+1]-first);
+        if (degree == 0)
+            return random.below(num_nodes);
+        const AliasTables::Slot& slot = tables.slots[first+random.below(degree)];
+        return random.uniform() < slot.probability ? slot.target : slot.alias;
+    };
+
+    const uint32_t num_walkers = std::min(options.num_walkers, num_steps);
+    const unsigned num_threads = std::min<unsigned>(options.num_threads > 0 ? options.num_threads : std::max(1u, std::thread::hardware_concurrency()),
+                                                    (num_walkers+walker_block_size-1)/walker_block_size);
+
+    // 1. the walkers in blocks to the threads; every thread counts into a histogram of its own that it allocates
+    // itself, so the threads never write to the same cache lines
+    std::vector<std::vector<uint32_t>> histograms(num_threads);
+    std::atomic<uint32_t> next_walker {0};
+    std::vector<std::thread> threads;
+    for (unsigned t=0; t<num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            std::vector<uint32_t> histogram(num_nodes, 0);
+            for (uint32_t first = next_walker.fetch_add(walker_block_size); first < num_walkers; first = next_walker.fetch_add(walker_block_size)) {
+                for (uint32_t walker=first; walker<std::min(first+walker_block_size, num_walkers); ++walker) {
+                    WalkerRandom random(seed, walker, simulation);
+                    const uint32_t walker_steps = num_steps/num_walkers+(walker < num_steps % num_walkers ? 1 : 0);
+                    uint32_t node = random.below(num_nodes);
+                    for (uint32_t i=0; i<walker_steps; ++i) {
+                        node = step(node, random);
+                        ++histogram[node];
+                    }
+                }
+            }
+            histograms[t] = std::move(histogram);
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // 2. the sums of the histograms, every thread adds up a range of nodes
+    threads.clear();
+    const uint32_t range_size = (num_nodes+num_threads-1)/num_threads;
+    for (unsigned t=0; t<num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            const uint32_t first = std::min(num_nodes, t*range_size);
+            const uint32_t last = std::min(num_nodes, first+range_size);
+            for (const std::vector<uint32_t>& histogram : histograms)
+                for (uint32_t node=first; node<last; ++node)
+                    visits[node] += histogram[node];
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void RandomWalkGraph::prepare_alias_tables(unsigned num_threads) {
+    // nodes can be added without changing the edges, the tables then lack their nodes
+    if (alias_version == get_edge_version() && alias_tables.num_nodes() == size())
+        return;
+    alias_tables = AliasTables(*this, num_threads);
+    alias_version = get_edge_version();
+}
+
+void RandomWalkGraph::simulate_random_walk(uint32_t num_steps, const WalkOptions& options) {
+    if (num_steps == 0)
+        return;
+    prepare_alias_tables(options.num_threads);
+    ::simulate_random_walk(alias_tables, visit_counts(), num_steps, seed_value, num_simulations, options);
+    ++num_simulations;
+}
 
 void RandomWalkGraph::write_histogram_pgm(const std::string& filename, uint32_t width, uint32_t height) const {
     // TODO: 10.3 b)
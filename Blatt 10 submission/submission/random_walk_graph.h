@@ -2,26 +2,137 @@
 
 #include "adjacency_list_graph.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <iterator>
-#include <random>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
 
+struct WalkOptions {
+    /// independent walkers that share the steps; the result depends on their number but not on the threads
+    uint32_t num_walkers = 1024;
+    /// 0 for std::thread::hardware_concurrency()
+    unsigned num_threads = 0;
+};
+
+/// The alias tables (Vose's method) of all nodes of a graph for the weighted steps of a random walk: a uniformly chosen
+/// slot of a node leads to its target with the probability of the slot and to its alias otherwise, so a step takes O(1)
+/// time. There is one slot per edge with a positive weight, edges with other weights (NaN marks removed edges) are
+/// never taken.
+class AliasTables {
+public:
+    AliasTables() = default;
+
+    /// builds the tables of graph with num_threads threads (0 for all cores); graph can be any graph with size() and
+    /// get_edges_starting_at that yields (target, weight) pairs, e.g. AdjacencyListGraph, FrozenGraph or the view
+    /// returned by open_mapped
+    template <typename Graph>
+    explicit AliasTables(const Graph& graph, unsigned num_threads=0)
+    {
+        build(graph.size(), num_threads, [&graph](uint32_t node, std::vector<uint32_t>& targets, std::vector<double>& weights) {
+            for (const auto& [to, weight] : graph.get_edges_starting_at(node))
+                if (weight > 0.0f) {
+                    targets.push_back(to);
+                    weights.push_back(static_cast<double>(weight));
+                }
+        });
+    }
+
+    size_t num_nodes() const { return offsets.empty() ? 0 : offsets.size()-1; }
+
+private:
+    struct Slot {
+        float probability;
+        uint32_t target;
+        uint32_t alias;
+    };
+
+    /// appends the edges with a positive weight of a node to targets and weights
+    using EdgeSource = std::function<void(uint32_t node, std::vector<uint32_t>& targets, std::vector<double>& weights)>;
+    void build(size_t num_nodes, unsigned num_threads, const EdgeSource& edges_of);
+
+    friend void simulate_random_walk(const AliasTables&, std::span<uint32_t>, uint32_t, uint64_t, uint64_t, const WalkOptions&);
+
+    /// the tables of all nodes in one array, the slots of node v are at [offsets[v], offsets[v+1])
+    std::vector<uint64_t> offsets;
+    std::vector<Slot> slots;
+};
+
+/// Lets options.num_walkers walkers take num_steps steps in total on the graph of tables and adds the visits to
+/// visits, which has one count per node. Every walker starts at a uniformly random node and follows an outgoing edge
+/// with a probability proportional to its weight; at a node without (positively weighted) outgoing edges it jumps to a
+/// uniformly random node. Every step counts a visit of the node it reaches.
+///
+/// The walkers run in parallel. Each has its own stream of a counter-based generator (Philox4x32-10, keyed by seed and
+/// addressed by walker and simulation), and each thread counts into its own histogram, the histograms are added up at
+/// the end. So the counts are the same for every number of threads, and walks with different simulation numbers use
+/// different random numbers.
+void simulate_random_walk(const AliasTables& tables, std::span<uint32_t> visits, uint32_t num_steps, uint64_t seed,
+                          uint64_t simulation, const WalkOptions& options);
+
+/// simulate_random_walk on any graph (see AliasTables), e.g. a FrozenGraph or a mapped file; builds the alias tables
+/// on every call, so walks on the same graph should build them once and pass them instead
+template <typename Graph>
+void simulate_random_walk(const Graph& graph, std::span<uint32_t> visits, uint32_t num_steps, uint64_t seed,
+                          uint64_t simulation=0, const WalkOptions& options=WalkOptions{})
+{
+    simulate_random_walk(AliasTables(graph, options.num_threads), visits, num_steps, seed, simulation, options);
+}
+
+/// the visit counts scaled such that the largest one becomes max_value
+template <typename T>
+std::vector<T> compute_normalized_histogram(std::span<const uint32_t> visits, T max_value) {
+    std::vector<T> hist;
+    hist.reserve(visits.size());
+    if (visits.empty())
+        return hist;
+
+    const uint32_t max_visited = *std::max_element(visits.begin(), visits.end());
+    const float normalization = max_visited > 0 ? static_cast<float>(max_value)/static_cast<float>(max_visited) : 0.0f;
+    std::transform(visits.begin(), visits.end(), std::back_inserter(hist), [=](uint32_t count) -> T { return static_cast<T>(static_cast<float>(count)*normalization); });
+
+    return hist;
+}
+
+/// The nodes count how often they were visited by the random walks.
 class RandomWalkGraph : public AdjacencyListGraph<uint32_t, RandomWalkGraph> {
+public:
+    using WalkOptions = ::WalkOptions;
+
 private:
-    std::default_random_engine prng;
+    uint64_t seed_value = 0;
+    /// number of simulations so far, every simulation continues with fresh random numbers
+    uint64_t num_simulations = 0;
+
+    AliasTables alias_tables;
+    /// the edge version (see get_edge_version) the tables were built for, they also have to cover all nodes
+    std::optional<uint64_t> alias_version;
+
+    std::span<uint32_t> visit_counts() { return size() > 0 ? std::span<uint32_t>(&(*this)[0], size()) : std::span<uint32_t>(); }
 
 public:
-    void simulate_random_walk(uint32_t num_steps);
+    /// restarts the random numbers, the simulations after seed(s) are the same for the same s
+    void seed(uint64_t s) { seed_value = s; num_simulations = 0; }
 
-    template<typename T>
-    std::vector<T> compute_normalized_histogram(T max_value) const {
-        std::vector<T> hist;
-        hist.reserve(size());
+    /// the visit counts of all nodes (the node values)
+    std::span<const uint32_t> get_visit_counts() const { return size() > 0 ? std::span<const uint32_t>(&(*this)[0], size()) : std::span<const uint32_t>(); }
 
-        const uint32_t max_visited = *std::max_element(cbegin(), cend());
-        const float normalization = max_visited > 0 ? static_cast<float>(max_value)/static_cast<float>(max_visited) : 0.0f;
-        std::transform(cbegin(), cend(), std::back_inserter(hist), [=](int count) -> T { return static_cast<T>(static_cast<float>(count)*normalization); });
+    /// Builds the alias tables for the weighted steps with num_threads threads (0 for all cores) unless they are up to
+    /// date. They are built once and rebuilt after edges or nodes were added or edges removed, simulate_random_walk
+    /// calls this itself.
+    void prepare_alias_tables(unsigned num_threads=0);
 
-        return hist;
+    /// Lets num_walkers walkers take num_steps steps in total and adds the visits to the counts of the nodes, see
+    /// ::simulate_random_walk. Frozen or mapped copies of the graph can be walked with the free function.
+    void simulate_random_walk(uint32_t num_steps) { simulate_random_walk(num_steps, WalkOptions{}); }
+    void simulate_random_walk(uint32_t num_steps, const WalkOptions& options);
+
+    template<typename T>
+    std::vector<T> compute_normalized_histogram(T max_value) const {
+        return ::compute_normalized_histogram(get_visit_counts(), max_value);
     }
 
     /// arrange the nodes in the graph as a 2d grid and export the histogram as a greyscale image
@@ -2,6 +2,7 @@
 #include "submission/transformations.h"
 #include "submission/operations.h"
 #include "submission/voxel_grid.h"
+#include "submission/voxel_path.h"
 
 #include <cstdlib>
 #include <iostream>
@@ -14,6 +15,13 @@ int main() {
     try {
         VoxelGrid vg = your_shape();
         std::cout << vg;
+
+        // collision-free path through the spherical cavity of a cube, around a plate in its middle
+        const VoxelGrid cavity = Cube{} - Sphere{}.scaled({0.9f, 0.9f, 0.9f}) + Cube{}.scaled({0.5f, 0.5f, 0.1f});
+        const auto [res_x, res_y, res_z] = cavity.getResolution();
+        const VoxelPathfinder pathfinder(cavity);
+        const VoxelPath path = pathfinder.findPath({res_x/2, res_y/2, 2}, {res_x/2, res_y/2, res_z-3});
+        std::cout << "path around the plate: " << path.voxels.size() << " voxels, length " << path.length << std::endl;
     }
     catch (std::logic_error& e) {
         std::cout << "you need to implement " << e.what() << " to get some output here!" << std::endl;
@@ -22,13 +22,14 @@ VoxelGrid::VoxelGrid(const Shape& shape)
                     static_cast<uint32_t>(resolution.y) : 1;
     res_z = (resolution.z >= 1 && !std::isinf(resolution.z)) ? 
                     static_cast<uint32_t>(resolution.z) : 1;
-    voxels.resize(res_x*res_y*res_z-1+res_y*res_z-1+res_z);
+    voxels.assign(static_cast<size_t>(res_x)*res_y*res_z/64+2, 0);
     for (uint32_t x = 0; x < res_x; x++){
         for (uint32_t y = 0; y < res_y; y++) {
             for (uint32_t z = 0; z < res_z; z++){
-                if (shape.isInside(voxelCenter(x,y,z)))
-                    voxels[x*res_y*res_z+y*res_z+z] = true;
-                else voxels[x*res_y*res_z+y*res_z+z] = false;
+                if (shape.isInside(voxelCenter(x,y,z))) {
+                    const size_t index = static_cast<size_t>(x)*res_y*res_z+y*res_z+z;
+                    voxels[index >> 6] |= uint64_t{1} << (index & 63);
+                }
             }
         }
     }
@@ -39,6 +40,11 @@ std::tuple<uint32_t, uint32_t, uint32_t> VoxelGrid::getResolution() const
     return {res_x, res_y, res_z};
 }
 
+std::span<const uint64_t> VoxelGrid::getOccupancy() const
+{
+    return voxels;
+}
+
 VoxelSlice VoxelGrid::extractSlice(Axis axis, uint32_t slice) const
 {
     if (Axis::Z == axis) {
@@ -111,7 +117,8 @@ bool VoxelGrid::isSet(uint32_t x, uint32_t y, uint32_t z) const
     assert(y < res_y);
     assert(z < res_z);
 
-    return voxels.at(x*res_y*res_z + y*res_z + z);
+    const size_t index = static_cast<size_t>(x)*res_y*res_z + y*res_z + z;
+    return voxels.at(index >> 6) >> (index & 63) & 1;
     }
 
 Point3D VoxelGrid::voxelCenter(uint32_t x, uint32_t y, uint32_t z) const
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <memory>
 #include <ostream>
+#include <span>
 #include <vector>
 
 struct VoxelSlice {
@@ -27,8 +28,8 @@ private:
 
     /// resolution of the voxel grid in x, y, z
     uint32_t res_x {0}, res_y {0}, res_z {0};
-    /// flat voxel storage
-    std::vector<bool> voxels;
+    /// flat voxel storage, one bit per voxel packed into 64-bit words, plus a spare word at the end
+    std::vector<uint64_t> voxels;
 
 public:
     /// implicit conversion from shape to voxel grid - this declaration disables the default constructor
@@ -40,6 +41,10 @@ public:
     /// returns the yz/zx/xy plane at the specified x/y/z index
     VoxelSlice extractSlice(Axis axis, uint32_t slice) const;
 
+    /// packed occupancy of all voxels: voxel (x, y, z) is bit i % 64 of word i / 64 with i = (x*res_y + y)*res_z + z;
+    /// the last word is spare, so that two consecutive words can be read at every voxel
+    std::span<const uint64_t> getOccupancy() const;
+
 private:
     Shape clone_impl() const override;
     AABB getBounds_impl() const override;
@@ -0,0 +1,377 @@
+#include "voxel_path.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+    constexpr float sqrt2 = 1.41421356f;
+    constexpr float sqrt3 = 1.73205081f;
+
+    uint32_t bit(int32_t dx, int32_t dy, int32_t dz)
+    {
+        return 1u << ((dx+1)*9 + (dy+1)*3 + (dz+1));
+    }
+
+    /// bits of all voxels in the bounding box of the given offsets
+    uint32_t box(std::initializer_list<std::array<int32_t, 3>> offsets)
+    {
+        std::array<int32_t, 3> lo {1, 1, 1}, hi {-1, -1, -1};
+        for (const auto& offset : offsets) {
+            for (size_t i = 0; i < 3; i++) {
+                lo[i] = std::min(lo[i], offset[i]);
+                hi[i] = std::max(hi[i], offset[i]);
+            }
+        }
+        uint32_t bits = 0;
+        for (int32_t x = lo[0]; x <= hi[0]; x++)
+            for (int32_t y = lo[1]; y <= hi[1]; y++)
+                for (int32_t z = lo[2]; z <= hi[2]; z++)
+                    bits |= bit(x, y, z);
+        return bits;
+    }
+
+    /// per-thread search state, reused between queries; entries are only valid if their stamp is the current one,
+    /// so nothing has to be cleared for a new query, and they are allocated in pages when a query first reaches one
+    /// of their voxels, so a query only touches the pages around the voxels it visits
+    struct Workspace {
+        /// the state of a voxel in one place, so that relaxing a step touches a single cache line
+        struct Entry {
+            float dist;
+            uint32_t predecessor;
+            uint32_t stamp;
+            /// direction in which the voxel was reached
+            uint8_t direction;
+            bool settled;
+        };
+        static constexpr uint32_t page_bits = 12;
+        std::vector<std::unique_ptr<Entry[]>> pages;
+        uint32_t stamp = 0;
+        /// min-heap of (tentative distance + heuristic, voxel), may contain outdated entries
+        std::vector<std::pair<float, uint32_t>> queue;
+
+        void reset(size_t num_voxels)
+        {
+            if (stamp == std::numeric_limits<uint32_t>::max()) {
+                pages.clear();
+                stamp = 0;
+            }
+            pages.resize(std::max(pages.size(), (num_voxels >> page_bits) + 1));
+            stamp++;
+            queue.clear();
+        }
+
+        Entry& operator[](uint32_t voxel)
+        {
+            std::unique_ptr<Entry[]>& page = pages[voxel >> page_bits];
+            // value-initialised, stamp 0 is never current
+            if (!page)
+                page = std::make_unique<Entry[]>(size_t{1} << page_bits);
+            return page[voxel & ((1u << page_bits) - 1)];
+        }
+    };
+}
+
+VoxelPathfinder::VoxelPathfinder(const VoxelGrid& voxel_grid, Connectivity neighbours)
+    : connectivity(neighbours)
+{
+    const auto [rx, ry, rz] = voxel_grid.getResolution();
+    res_x = rx;
+    res_y = ry;
+    res_z = rz;
+    stride_y = res_z;
+    stride_x = res_y*stride_y;
+    num_voxels = static_cast<size_t>(res_x*stride_x);
+    if (num_voxels >= std::numeric_limits<uint32_t>::max())
+        throw std::length_error("voxel grid too large for path finding");
+    cells = voxel_grid.getOccupancy().data();
+
+    // most diagonal directions first, this is the canonical order of the steps of a path
+    const int32_t max_axes = connectivity == Connectivity::Six ? 1 : connectivity == Connectivity::Eighteen ? 2 : 3;
+    for (int32_t axes = max_axes; axes >= 1; axes--) {
+        for (int32_t dx = -1; dx <= 1; dx++) {
+            for (int32_t dy = -1; dy <= 1; dy++) {
+                for (int32_t dz = -1; dz <= 1; dz++) {
+                    if (std::abs(dx)+std::abs(dy)+std::abs(dz) != axes)
+                        continue;
+                    const float cost = axes == 1 ? 1.0f : axes == 2 ? sqrt2 : sqrt3;
+                    directions.push_back({dx, dy, dz, cost, box({{0, 0, 0}, {dx, dy, dz}}) & ~bit(0, 0, 0), dx*stride_x + dy*stride_y + dz});
+                }
+            }
+        }
+    }
+    // the straight steps along z last: with 6-connectivity the last two are the ones that jump, and rays along z
+    // are scanned word by word
+    std::stable_partition(directions.end()-6, directions.end(), [](const Direction& dir) { return dir.dz == 0; });
+
+    // e may follow d on a canonical path if it does not come earlier in the order and the two steps cannot be
+    // replaced by a shorter combination: then every obstacle-free shortest path has a canonical reordering
+    canonical.assign(directions.size(), 0);
+    alternatives.assign(directions.size(), {});
+    any_alternative.assign(directions.size(), 0);
+    for (size_t d = 0; d < directions.size(); d++) {
+        const Direction& a = directions[d];
+        for (size_t e = 0; e < directions.size(); e++) {
+            const Direction& b = directions[e];
+            const float combined = estimate(a.dx+b.dx, a.dy+b.dy, a.dz+b.dz);
+            if (e >= d && a.cost+b.cost <= combined+1e-4f)
+                canonical[d] |= 1u << e;
+            else
+                alternatives[d][e] = box({{-a.dx, -a.dy, -a.dz}, {0, 0, 0}, {b.dx, b.dy, b.dz}});
+            any_alternative[d] |= alternatives[d][e];
+        }
+        // with 18-connectivity, edge steps have canonical successors along all three axes: nearly every voxel is
+        // reached by an edge step and would scan long rays again, the pruning alone is faster there
+        if (canonical[d] == 1u << d && connectivity != Connectivity::Eighteen)
+            jumping |= 1u << d;
+    }
+}
+
+bool VoxelPathfinder::isFree(VoxelIndex voxel) const
+{
+    if (voxel.x >= res_x || voxel.y >= res_y || voxel.z >= res_z)
+        return false;
+    return !occupied(index_of(voxel.x, voxel.y, voxel.z));
+}
+
+VoxelIndex VoxelPathfinder::voxel_of(uint32_t index) const
+{
+    return {static_cast<uint32_t>(index/stride_x), static_cast<uint32_t>(index/stride_y%res_y), static_cast<uint32_t>(index%stride_y)};
+}
+
+uint32_t VoxelPathfinder::row(uint64_t index, uint32_t z) const
+{
+    // rows of three voxels along z are adjacent bits, possibly spanning two words
+    uint32_t bits = z > 0 ? static_cast<uint32_t>(bits_from(index-1) & 0x7) : static_cast<uint32_t>(bits_from(index) << 1 & 0x6) | 1;
+    if (z+1 == res_z)
+        bits |= 4;
+    return bits;
+}
+
+uint32_t VoxelPathfinder::neighbourhood(uint32_t index, VoxelIndex voxel) const
+{
+    uint32_t bits = 0;
+    for (int64_t dx = -1; dx <= 1; dx++) {
+        const bool inside_x = voxel.x+dx >= 0 && voxel.x+dx < res_x;
+        for (int64_t dy = -1; dy <= 1; dy++) {
+            const bool inside = inside_x && voxel.y+dy >= 0 && voxel.y+dy < res_y;
+            const uint32_t occupancy = inside ? row(static_cast<uint64_t>(index + dx*stride_x + dy*stride_y), voxel.z) : 0x7;
+            bits |= occupancy << ((dx+1)*9 + (dy+1)*3);
+        }
+    }
+    return bits;
+}
+
+uint32_t VoxelPathfinder::advance(uint32_t previous, uint32_t index, VoxelIndex voxel, size_t d) const
+{
+    const Direction& dir = directions[d];
+    const auto inside = [&](int64_t dx, int64_t dy, int64_t dz) {
+        return voxel.x+dx >= 0 && voxel.x+dx < res_x && voxel.y+dy >= 0 && voxel.y+dy < res_y && voxel.z+dz >= 0 && voxel.z+dz < res_z;
+    };
+    const auto at = [&](int64_t dx, int64_t dy) { return static_cast<uint64_t>(index + dx*stride_x + dy*stride_y); };
+
+    uint32_t bits = 0;
+    if (dir.dx != 0) {
+        // the planes of constant x are blocks of nine bits
+        bits = dir.dx > 0 ? previous >> 9 : previous << 9 & 0x7fffe00;
+        for (int32_t dy = -1; dy <= 1; dy++)
+            bits |= (inside(dir.dx, dy, 0) ? row(at(dir.dx, dy), voxel.z) : 0x7) << ((dir.dx+1)*9 + (dy+1)*3);
+    }
+    else if (dir.dy != 0) {
+        // the rows of constant y are three bits in every block
+        constexpr uint32_t low_rows = 0x3f | 0x3f << 9 | 0x3f << 18;
+        bits = dir.dy > 0 ? previous >> 3 & low_rows : previous << 3 & low_rows << 3;
+        for (int32_t dx = -1; dx <= 1; dx++)
+            bits |= (inside(dx, dir.dy, 0) ? row(at(dx, dir.dy), voxel.z) : 0x7) << ((dx+1)*9 + (dir.dy+1)*3);
+    }
+    else {
+        // the voxels of constant z are every third bit
+        constexpr uint32_t low_voxels = 0xdb | 0xdb << 9 | 0xdb << 18;
+        bits = dir.dz > 0 ? previous >> 1 & low_voxels : previous << 1 & low_voxels << 1;
+        for (int32_t dx = -1; dx <= 1; dx++)
+            for (int32_t dy = -1; dy <= 1; dy++)
+                if (!inside(dx, dy, dir.dz) || occupied(static_cast<uint32_t>(at(dx, dy) + static_cast<uint64_t>(dir.dz))))
+                    bits |= 1u << ((dx+1)*9 + (dy+1)*3 + dir.dz+1);
+    }
+    return bits;
+}
+
+uint32_t VoxelPathfinder::free_run(uint32_t index, VoxelIndex voxel, int32_t dz) const
+{
+    // the occupancy of the nine rows from the voxel on, ahead is towards the high bits for dz > 0 and towards the
+    // low bits otherwise
+    uint64_t any = 0;
+    for (int64_t dx = -1; dx <= 1; dx++) {
+        for (int64_t dy = -1; dy <= 1; dy++) {
+            const auto position = static_cast<uint64_t>(index + dx*stride_x + dy*stride_y);
+            if (dz > 0)
+                any |= bits_from(position);
+            else
+                any |= position >= 63 ? bits_from(position-63) : bits_from(0) << (63-position);
+        }
+    }
+    // the neighbourhood after s steps covers s-1 to s+1 voxels ahead; the bits beyond the grid belong to other rows
+    const int64_t free = (dz > 0 ? std::countr_zero(any) : std::countl_zero(any)) - 2;
+    const int64_t remaining = dz > 0 ? res_z-2-voxel.z : int64_t{voxel.z}-1;
+    return static_cast<uint32_t>(std::max(int64_t{0}, std::min(free, remaining)));
+}
+
+float VoxelPathfinder::estimate(int64_t dx, int64_t dy, int64_t dz) const
+{
+    dx = std::abs(dx);
+    dy = std::abs(dy);
+    dz = std::abs(dz);
+    const int64_t a = std::max({dx, dy, dz});
+    const int64_t c = std::min({dx, dy, dz});
+    const int64_t b = dx+dy+dz-a-c;
+    switch (connectivity) {
+    case Connectivity::Six:
+        return static_cast<float>(a+b+c);
+    case Connectivity::Eighteen:
+        // every edge step covers two axes, they can cover all but one unit unless one axis dominates
+        if (a >= b+c)
+            return static_cast<float>(b+c)*sqrt2 + static_cast<float>(a-b-c);
+        return static_cast<float>((a+b+c)/2)*sqrt2 + static_cast<float>((a+b+c)%2);
+    case Connectivity::TwentySix:
+        return static_cast<float>(c)*sqrt3 + static_cast<float>(b-c)*sqrt2 + static_cast<float>(a-b);
+    }
+    return 0.0f;
+}
+
+uint32_t VoxelPathfinder::successors(uint32_t occupied, size_t d) const
+{
+    if (d == directions.size())
+        return (1u << directions.size())-1;
+
+    uint32_t result = canonical[d];
+    if (!(occupied & any_alternative[d]))
+        return result;
+    for (size_t e = 0; e < directions.size(); e++)
+        if (!(canonical[d] >> e & 1) && !(occupied & directions[e].box) && (occupied & alternatives[d][e]))
+            result |= 1u << e;
+    return result;
+}
+
+uint32_t VoxelPathfinder::jump(uint32_t index, VoxelIndex voxel, uint32_t occupied, size_t d, VoxelIndex goal) const
+{
+    const Direction& dir = directions[d];
+    // away from the border in x and y, rays along z skip the voxels with free neighbourhoods word by word
+    const bool skip = dir.dz != 0 && voxel.x > 0 && voxel.x+1 < res_x && voxel.y > 0 && voxel.y+1 < res_y;
+    uint32_t steps = 0;
+    // the last neighbourhood without forced neighbours, none at first (neighbourhoods have 27 bits)
+    uint32_t unforced = ~0u;
+    while (!(occupied & dir.box)) {
+        if (skip) {
+            const uint32_t run = free_run(index, voxel, dir.dz);
+            if (run > 0) {
+                const int64_t to_goal = (int64_t{goal.z}-voxel.z)*dir.dz;
+                if (goal.x == voxel.x && goal.y == voxel.y && to_goal > 0 && to_goal <= run)
+                    return steps + static_cast<uint32_t>(to_goal);
+                steps += run;
+                index = static_cast<uint32_t>(index + run*dir.offset);
+                voxel.z = static_cast<uint32_t>(voxel.z + static_cast<int64_t>(run)*dir.dz);
+                occupied = unforced = 0;
+                continue;
+            }
+        }
+        steps++;
+        index = static_cast<uint32_t>(index + dir.offset);
+        voxel = {static_cast<uint32_t>(int64_t{voxel.x} + dir.dx), static_cast<uint32_t>(int64_t{voxel.y} + dir.dy), static_cast<uint32_t>(int64_t{voxel.z} + dir.dz)};
+        if (voxel == goal)
+            return steps;
+        occupied = advance(occupied, index, voxel, d);
+        // along walls the neighbourhood repeats, if it had no forced neighbour a step before it has none now
+        if (occupied != unforced) {
+            if (successors(occupied, d) != canonical[d])
+                return steps;
+            unforced = occupied;
+        }
+    }
+    return 0;
+}
+
+VoxelPath VoxelPathfinder::findPath(VoxelIndex from, VoxelIndex to, bool jump_points) const
+{
+    if (from.x >= res_x || from.y >= res_y || from.z >= res_z || to.x >= res_x || to.y >= res_y || to.z >= res_z)
+        throw std::out_of_range("voxel outside the grid");
+
+    VoxelPath path {{}, std::numeric_limits<float>::infinity()};
+    if (!isFree(from) || !isFree(to))
+        return path;
+
+    const auto heuristic = [&](int64_t x, int64_t y, int64_t z) {
+        return estimate(x-to.x, y-to.y, z-to.z);
+    };
+
+    thread_local Workspace ws;
+    ws.reset(num_voxels);
+    const uint32_t source = index_of(from.x, from.y, from.z);
+    const uint32_t goal = index_of(to.x, to.y, to.z);
+    const auto by_priority = [](const auto& a, const auto& b) { return a.first > b.first; };
+
+    ws[source] = {0.0f, source, ws.stamp, static_cast<uint8_t>(directions.size()), false};
+    ws.queue.emplace_back(heuristic(from.x, from.y, from.z), source);
+    while (!ws.queue.empty()) {
+        std::pop_heap(ws.queue.begin(), ws.queue.end(), by_priority);
+        const uint32_t u = ws.queue.back().second;
+        ws.queue.pop_back();
+        // the heuristic is consistent, a voxel is final when it is popped first; later entries are outdated
+        Workspace::Entry& current = ws[u];
+        if (current.settled)
+            continue;
+        current.settled = true;
+        if (u == goal)
+            break;
+
+        const VoxelIndex voxel = voxel_of(u);
+        const uint32_t occupied = neighbourhood(u, voxel);
+        const uint32_t expand = jump_points ? successors(occupied, current.direction) : (1u << directions.size())-1;
+        for (uint32_t remaining = expand; remaining; remaining &= remaining-1) {
+            const auto e = static_cast<size_t>(std::countr_zero(remaining));
+            const Direction& dir = directions[e];
+            if (occupied & dir.box)
+                continue;
+            uint32_t steps = 1;
+            if (jump_points && (jumping >> e & 1))
+                steps = jump(u, voxel, occupied, e, to);
+            if (steps == 0)
+                continue;
+            const auto v = static_cast<uint32_t>(u + steps*dir.offset);
+            Workspace::Entry& next = ws[v];
+            const float dist = current.dist + static_cast<float>(steps)*dir.cost;
+            if (next.stamp == ws.stamp && (next.settled || next.dist <= dist))
+                continue;
+            next = {dist, u, ws.stamp, static_cast<uint8_t>(e), false};
+            const int64_t n = steps;
+            ws.queue.emplace_back(dist+heuristic(voxel.x + n*dir.dx, voxel.y + n*dir.dy, voxel.z + n*dir.dz), v);
+            std::push_heap(ws.queue.begin(), ws.queue.end(), by_priority);
+        }
+    }
+    if (ws[goal].stamp != ws.stamp)
+        return path;
+
+    // jump points are connected by straight or diagonal lines, fill in the voxels between them
+    path.length = ws[goal].dist;
+    for (uint32_t u = goal; ; u = ws[u].predecessor) {
+        const VoxelIndex end = voxel_of(u);
+        const VoxelIndex begin = voxel_of(ws[u].predecessor);
+        VoxelIndex voxel = end;
+        while (!(voxel == begin)) {
+            path.voxels.push_back(voxel);
+            voxel.x = voxel.x > begin.x ? voxel.x-1 : voxel.x < begin.x ? voxel.x+1 : voxel.x;
+            voxel.y = voxel.y > begin.y ? voxel.y-1 : voxel.y < begin.y ? voxel.y+1 : voxel.y;
+            voxel.z = voxel.z > begin.z ? voxel.z-1 : voxel.z < begin.z ? voxel.z+1 : voxel.z;
+        }
+        if (u == source)
+            break;
+    }
+    path.voxels.push_back(from);
+    std::reverse(path.voxels.begin(), path.voxels.end());
+    return path;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "voxel_grid.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/// which neighbours of a voxel can be reached in one step: sharing a face, a face or an edge, or any neighbour
+enum class Connectivity { Six = 6, Eighteen = 18, TwentySix = 26 };
+
+/// integer voxel coordinates in a VoxelGrid
+struct VoxelIndex {
+    uint32_t x, y, z;
+
+    bool operator==(const VoxelIndex& other) const = default;
+};
+
+struct VoxelPath {
+    /// every voxel from start to goal, both included; empty if the goal cannot be reached
+    std::vector<VoxelIndex> voxels;
+    /// length in voxels (a face step costs 1, an edge step sqrt(2), a corner step sqrt(3)); infinite if unreachable
+    float length;
+};
+
+/// Collision-free paths through the free (unset) voxels of a VoxelGrid, computed directly on its packed occupancy
+/// without building a graph. Voxels outside the grid count as occupied. A diagonal step is only allowed if all
+/// voxels of the box it spans are free, so paths never cut corners or squeeze through edge contacts.
+///
+/// findPath runs A* with the exact obstacle-free distance as heuristic, optionally with jump point search: a voxel only
+/// expands the steps that may follow the step it was reached with on a canonical path (steps sorted from the most to
+/// the least diagonal), plus its forced neighbours, i.e. the ones whose canonical alternative is blocked by an
+/// obstacle. Steps that are their own only canonical successor (straight steps, only those along z with 6-connectivity)
+/// jump until the next voxel with a forced neighbour; rays along z skip free stretches a word of occupancy at a time,
+/// the others read one new plane of three rows per voxel. Other steps advance one voxel: scanning the canonical
+/// successors at every voxel of a diagonal, as in 2D, would sweep whole volumes in 3D. With 18-connectivity, only the
+/// pruning is used. Both variants return paths of the same length; jump points pay off most in scenes with large
+/// obstacles.
+///
+/// Queries on a million voxels take 1-2 ms as long as the heuristic guides the search, e.g. between scattered
+/// blocks. Scenes that force it around large obstacles take longer, since it then visits most of the free space: on
+/// 100^3 voxels with four walls that each have a 4x4 hole, a query takes about 6 ms with jump points and
+/// 6-connectivity, 20-25 ms with 26-connectivity, 130 ms with 18-connectivity (which only prunes) and 120-350 ms
+/// without jump points.
+///
+/// The pathfinder reads the occupancy words of the grid in place, so the grid must outlive it and must not change
+/// meanwhile. Queries can run concurrently; each thread reuses its own search workspace, whose node records are
+/// allocated page by page as a query reaches them and are invalidated by a generation stamp instead of being cleared.
+class VoxelPathfinder {
+public:
+    VoxelPathfinder(const VoxelGrid& voxel_grid, Connectivity neighbours = Connectivity::TwentySix);
+
+    /// shortest path between two free voxels (throws std::out_of_range for voxels outside the grid)
+    VoxelPath findPath(VoxelIndex from, VoxelIndex to, bool jump_points = true) const;
+
+    /// whether the voxel is inside the grid and not occupied
+    bool isFree(VoxelIndex voxel) const;
+
+    Connectivity getConnectivity() const { return connectivity; }
+
+private:
+    /// a step to one of the 26 neighbours
+    struct Direction {
+        int32_t dx, dy, dz;
+        float cost;
+        /// bits of the voxels in the 3x3x3 neighbourhood (see neighbourhood()) that must be free to take the step
+        uint32_t box;
+        /// difference of the indices of the voxels before and after the step
+        int64_t offset;
+    };
+
+    /// index of a voxel in the occupancy
+    uint32_t index_of(int64_t x, int64_t y, int64_t z) const {
+        return static_cast<uint32_t>(x*stride_x + y*stride_y + z);
+    }
+    VoxelIndex voxel_of(uint32_t index) const;
+    bool occupied(uint32_t index) const { return cells[index >> 6] >> (index & 63) & 1; }
+    /// the 64 occupancy bits starting at index first
+    uint64_t bits_from(uint64_t first) const {
+        const uint64_t word = first >> 6, shift = first & 63;
+        return cells[word] >> shift | cells[word+1] << 1 << (63-shift);
+    }
+    /// occupancy of the voxels z-1, z, z+1 of the row along z through the voxel index (at z) as three bits, voxels
+    /// outside the grid are set
+    uint32_t row(uint64_t index, uint32_t z) const;
+    /// occupancy of the 3x3x3 neighbourhood of a free voxel as bits (dx+1)*9 + (dy+1)*3 + (dz+1), outside the grid is set
+    uint32_t neighbourhood(uint32_t index, VoxelIndex voxel) const;
+    /// the neighbourhood after a straight step along axis direction d: the bits shift by one plane and only the plane
+    /// entered anew is read
+    uint32_t advance(uint32_t occupied, uint32_t index, VoxelIndex voxel, size_t d) const;
+    /// number of steps along z from the voxel (not on the border in x or y) whose neighbourhoods are all free, read
+    /// from whole occupancy words; at most 62 per call
+    uint32_t free_run(uint32_t index, VoxelIndex voxel, int32_t dz) const;
+    /// exact distance without obstacles, the A* heuristic
+    float estimate(int64_t dx, int64_t dy, int64_t dz) const;
+    /// number of steps along direction d from the voxel with the given neighbourhood to the first voxel with a forced
+    /// neighbour (or the goal), 0 if there is none
+    uint32_t jump(uint32_t index, VoxelIndex voxel, uint32_t occupied, size_t d, VoxelIndex goal) const;
+    /// directions to expand from a voxel that was reached along d (or from the start if d == directions.size())
+    uint32_t successors(uint32_t occupied, size_t d) const;
+
+    int64_t res_x, res_y, res_z;
+    /// index differences of neighbours along x and y
+    int64_t stride_x, stride_y;
+    size_t num_voxels;
+    /// the occupancy words of the grid (see VoxelGrid::getOccupancy)
+    const uint64_t* cells;
+    Connectivity connectivity;
+
+    std::vector<Direction> directions;
+    /// canonical successors of each direction as bit sets over directions
+    std::vector<uint32_t> canonical;
+    /// per direction d and non-canonical direction e: the voxels that must be free for the canonical alternatives
+    /// of the step d followed by e; if one is occupied and e itself is possible, e is a forced neighbour
+    std::vector<std::array<uint32_t, 26>> alternatives;
+    /// union of the alternatives of each direction, no neighbour can be forced if all of these voxels are free
+    std::vector<uint32_t> any_alternative;
+    /// directions along which the search jumps, as bit set
+    uint32_t jumping = 0;
+};
@@ -0,0 +1,62 @@
+#include "submission/graph_generator.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Usage: generate_graph --out FILE [--layout knn|grid|delaunay] [--nodes N] [--degree K] [--spacing KM]
+//                       [--jitter J] [--drop P] [--detour D] [--seed S]
+// Writes a synthetic road-like graph as routing snapshot, which CompactGraph::load_snapshot reads at any size
+// (ShortestPaths::load_snapshot builds a dense matrix and is only feasible for small graphs).
+
+int main(int argc, char** argv) {
+    graph_generator::Options options;
+    std::string filename;
+
+    for (int i=1; i<argc; ++i) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i+1 >= argc)
+                throw std::invalid_argument("missing value for "+arg);
+            return argv[++i];
+        };
+        if (arg == "--out")
+            filename = value();
+        else if (arg == "--layout") {
+            const std::string layout = value();
+            if (layout == "knn")
+                options.layout = graph_generator::Layout::Knn;
+            else if (layout == "grid")
+                options.layout = graph_generator::Layout::Grid;
+            else if (layout == "delaunay")
+                options.layout = graph_generator::Layout::Delaunay;
+            else
+                throw std::invalid_argument("unknown layout "+layout);
+        }
+        else if (arg == "--nodes")
+            options.num_nodes = std::stoul(value());
+        else if (arg == "--degree")
+            options.degree = std::stoul(value());
+        else if (arg == "--spacing")
+            options.spacing = std::stof(value());
+        else if (arg == "--jitter")
+            options.jitter = std::stof(value());
+        else if (arg == "--drop")
+            options.drop = std::stof(value());
+        else if (arg == "--detour")
+            options.detour = std::stof(value());
+        else if (arg == "--seed")
+            options.seed = std::stoull(value());
+        else
+            throw std::invalid_argument("unknown argument "+arg);
+    }
+    if (filename.empty())
+        throw std::invalid_argument("no output file given (--out)");
+
+    const graph_generator::Stats stats = graph_generator::write_snapshot(filename, options);
+    std::cout << filename << ": " << stats.num_nodes << " nodes, " << stats.num_edges << " edges ("
+              << static_cast<double>(stats.num_edges)/static_cast<double>(stats.num_nodes) << " per node), "
+              << stats.memory_bytes/(1024*1024) << " MiB working memory, " << stats.seconds << " s" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,285 @@
+#include "submission/shortest_paths.h"
+#include "submission/city_graph.h"
+#include "submission/compact_graph.h"
+#include "submission/search_kernel.h"
+#include "submission/reach.h"
+#include "submission/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Usage: routing_bench [--csv FILE] [--synthetic NUM_NODES]... [--queries N] [--seed S] [--json FILE] [--trace FILE]
+// Runs every engine on every graph with two query sets and writes the results as JSON (routing_bench.json by default).
+// --trace writes the recorded events in the Chrome trace format, it needs a build with ENABLE_TRACING.
+
+namespace {
+
+    struct Query {
+        size_t from, to;
+        /// Dijkstra rank of the target (log2), 0 for random queries
+        unsigned rank = 0;
+    };
+
+    struct QuerySet {
+        std::string name;
+        std::vector<Query> queries;
+    };
+
+    /// what one query reports back to the benchmark
+    struct QueryResult {
+        float distance;
+        std::optional<size_t> settled;
+    };
+
+    struct Engine {
+        std::string name;
+        /// bytes of the graph representation including engine specific preprocessing
+        size_t memory_bytes;
+        double preprocessing_seconds;
+        std::function<QueryResult(size_t, size_t)> query;
+    };
+
+    struct Measurement {
+        std::string graph, engine, query_set;
+        size_t num_queries = 0;
+        double throughput = 0.0;
+        double p50_us = 0.0, p99_us = 0.0, p999_us = 0.0, max_us = 0.0;
+        std::optional<double> mean_settled;
+        size_t memory_bytes = 0;
+        double preprocessing_seconds = 0.0;
+        /// sum of all distances, to compare engines and to keep the queries from being optimized away
+        double checksum = 0.0;
+    };
+
+    QuerySet random_queries(const ShortestPaths& graph, size_t num_queries, uint64_t seed)
+    {
+        QuerySet set {"random", {}};
+        std::mt19937_64 prng(seed);
+        std::uniform_int_distribution<size_t> node(0, graph.size()-1);
+        for (size_t i=0; i<num_queries; ++i)
+            set.queries.push_back({node(prng), node(prng)});
+        return set;
+    }
+
+    /// for random sources, the targets are the nodes settled as 2^r-th by Dijkstra, for every rank r
+    QuerySet dijkstra_rank_queries(const ShortestPaths& graph, size_t num_sources, uint64_t seed)
+    {
+        QuerySet set {"dijkstra_rank", {}};
+        std::mt19937_64 prng(seed);
+        std::uniform_int_distribution<size_t> node(0, graph.size()-1);
+        ShortestPaths::SearchWorkspace ws;
+        search::NoStats stats;
+        for (size_t i=0; i<num_sources; ++i) {
+            const size_t source = node(prng);
+            search::run(ws, graph.size(), graph.to_internal(source), std::nullopt, search::NoHeuristic{}, stats, search::OutgoingEdges(graph));
+            std::vector<std::pair<float, size_t>> settled;
+            for (size_t v=0; v<graph.size(); ++v)
+                if (ws.visited[v])
+                    settled.emplace_back(ws.dists[v], v);
+            std::sort(settled.begin(), settled.end());
+            for (unsigned rank=1; (size_t{1} << rank) < settled.size(); ++rank)
+                set.queries.push_back({source, graph.to_external(settled[size_t{1} << rank].second), rank});
+        }
+        return set;
+    }
+
+    std::vector<Engine> make_engines(const ShortestPaths& graph)
+    {
+        std::vector<Engine> engines;
+        const size_t dense_bytes = graph.size()*(sizeof(ShortestPaths::Location)+graph.size()*sizeof(std::optional<float>));
+
+        const auto kernel_engine = [&graph](auto make_heuristic) {
+            return [&graph, make_heuristic](size_t from, size_t to) -> QueryResult {
+                thread_local ShortestPaths::SearchWorkspace ws;
+                search::CountingStats stats;
+                const size_t target = graph.to_internal(to);
+                search::run(ws, graph.size(), graph.to_internal(from), target, make_heuristic(target), stats, search::OutgoingEdges(graph));
+                return {ws.dists[target], stats.num_settled};
+            };
+        };
+
+        engines.push_back({"dijkstra", dense_bytes, 0.0, kernel_engine([](size_t) { return search::NoHeuristic{}; })});
+        engines.push_back({"astar_euclidean", dense_bytes, 0.0, kernel_engine([&graph](size_t target) { return search::EuclideanHeuristic(graph, target); })});
+
+        {
+            const auto start = std::chrono::steady_clock::now();
+            auto landmarks = std::make_shared<const search::Landmarks>(graph, 8);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            const size_t bytes = dense_bytes+2*landmarks->size()*graph.size()*sizeof(float);
+            engines.push_back({"alt_8", bytes, seconds, kernel_engine([landmarks](size_t target) { return search::AltHeuristic(*landmarks, target); })});
+        }
+
+        {
+            auto reach = std::make_shared<const ReachIndex>(graph);
+            const ReachIndex::BuildStats& build = reach->build_stats();
+            engines.push_back({"reach_astar", dense_bytes+build.memory_bytes, build.build_seconds, [&graph, reach](size_t from, size_t to) -> QueryResult {
+                thread_local ShortestPaths::SearchWorkspace ws;
+                search::CountingStats stats;
+                const size_t target = graph.to_internal(to);
+                const search::EuclideanHeuristic heuristic(graph, target);
+                search::run(ws, graph.size(), graph.to_internal(from), target, heuristic, stats, search::ReachPrunedEdges(*reach, ws, search::OutgoingEdges(graph), heuristic));
+                return {ws.dists[target], stats.num_settled};
+            }});
+        }
+
+        {
+            const auto start = std::chrono::steady_clock::now();
+            auto compact = std::make_shared<const CompactGraph<uint16_t>>(CompactGraph<uint16_t>::from(graph));
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            engines.push_back({"compact_u16", compact->memory_bytes(), seconds, [compact](size_t from, size_t to) -> QueryResult {
+                return {compact->distance(static_cast<uint32_t>(from), static_cast<uint32_t>(to)), std::nullopt};
+            }});
+        }
+        return engines;
+    }
+
+    Measurement measure(const std::string& graph_name, const Engine& engine, const QuerySet& set)
+    {
+        Measurement m;
+        m.graph = graph_name;
+        m.engine = engine.name;
+        m.query_set = set.name;
+        m.num_queries = set.queries.size();
+        m.memory_bytes = engine.memory_bytes;
+        m.preprocessing_seconds = engine.preprocessing_seconds;
+
+        std::vector<double> latencies;
+        latencies.reserve(set.queries.size());
+        size_t settled = 0;
+        bool has_settled = false;
+        const auto start = std::chrono::steady_clock::now();
+        for (const Query& query : set.queries) {
+            const auto query_start = std::chrono::steady_clock::now();
+            const QueryResult result = engine.query(query.from, query.to);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now()-query_start).count());
+            if (std::isfinite(result.distance))
+                m.checksum += static_cast<double>(result.distance);
+            if (result.settled) {
+                settled += *result.settled;
+                has_settled = true;
+            }
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        if (latencies.empty())
+            return m;
+
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&](double p) { return latencies[static_cast<size_t>(p*static_cast<double>(latencies.size()-1))]; };
+        m.throughput = static_cast<double>(latencies.size())/seconds;
+        m.p50_us = percentile(0.5);
+        m.p99_us = percentile(0.99);
+        m.p999_us = percentile(0.999);
+        m.max_us = latencies.back();
+        if (has_settled)
+            m.mean_settled = static_cast<double>(settled)/static_cast<double>(latencies.size());
+        return m;
+    }
+
+    void write_json(const std::string& filename, uint64_t seed, const std::vector<Measurement>& results)
+    {
+        std::ofstream file(filename, std::ofstream::out|std::ofstream::trunc);
+        if (!file)
+            throw std::runtime_error("cannot open "+filename);
+        file << "{\n  \"seed\": " << seed << ",\n  \"results\": [\n";
+        for (size_t i=0; i<results.size(); ++i) {
+            const Measurement& m = results[i];
+            file << "    {\"graph\": \"" << m.graph << "\", \"engine\": \"" << m.engine << "\", \"query_set\": \"" << m.query_set << "\""
+                 << ", \"queries\": " << m.num_queries
+                 << ", \"throughput_qps\": " << m.throughput
+                 << ", \"latency_us\": {\"p50\": " << m.p50_us << ", \"p99\": " << m.p99_us << ", \"p999\": " << m.p999_us << ", \"max\": " << m.max_us << "}"
+                 << ", \"mean_settled\": ";
+            if (m.mean_settled)
+                file << *m.mean_settled;
+            else
+                file << "null";
+            file << ", \"memory_bytes\": " << m.memory_bytes
+                 << ", \"preprocessing_s\": " << m.preprocessing_seconds
+                 << ", \"checksum\": " << m.checksum << "}" << (i+1 < results.size() ? "," : "") << "\n";
+        }
+        file << "  ]\n}\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string csv_file = "../de.csv";
+    std::vector<size_t> synthetic_sizes;
+    size_t num_queries = 1000;
+    uint64_t seed = 42;
+    std::string json_file = "routing_bench.json";
+    std::string trace_file;
+
+    for (int i=1; i<argc; ++i) {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> std::string {
+            if (i+1 >= argc)
+                throw std::invalid_argument("missing value for "+arg);
+            return argv[++i];
+        };
+        if (arg == "--csv")
+            csv_file = value();
+        else if (arg == "--synthetic")
+            synthetic_sizes.push_back(std::stoul(value()));
+        else if (arg == "--queries")
+            num_queries = std::stoul(value());
+        else if (arg == "--seed")
+            seed = std::stoull(value());
+        else if (arg == "--json")
+            json_file = value();
+        else if (arg == "--trace")
+            trace_file = value();
+        else
+            throw std::invalid_argument("unknown argument "+arg);
+    }
+    if (!trace_file.empty() && !trace::enabled)
+        throw std::invalid_argument("--trace needs a build with ENABLE_TRACING");
+    if (synthetic_sizes.empty())
+        synthetic_sizes.push_back(2000);
+
+    std::vector<std::pair<std::string, ShortestPaths>> graphs;
+    if (!csv_file.empty()) {
+        ShortestPaths cities = load_cities(csv_file);
+        connect_nearest(cities, 5);
+        graphs.emplace_back("de_knn5", std::move(cities));
+    }
+    for (size_t n : synthetic_sizes) {
+        // same density as the German cities: about 600 nodes on 600 x 800 km
+        const float side = std::sqrt(static_cast<float>(n)*800.0f);
+        ShortestPaths synthetic = random_locations(n, side, side, seed);
+        connect_nearest(synthetic, 5);
+        graphs.emplace_back("random_knn5_"+std::to_string(n), std::move(synthetic));
+    }
+
+    std::vector<Measurement> results;
+    for (const auto& [name, graph] : graphs) {
+        const std::vector<QuerySet> query_sets {random_queries(graph, num_queries, seed),
+                                                dijkstra_rank_queries(graph, std::max<size_t>(1, num_queries/16), seed)};
+        for (const Engine& engine : make_engines(graph)) {
+            for (const QuerySet& set : query_sets) {
+                results.push_back(measure(name, engine, set));
+                const Measurement& m = results.back();
+                std::cout << name << " " << engine.name << " " << set.name << ": " << m.throughput << " q/s, p50 " << m.p50_us
+                          << " us, p99 " << m.p99_us << " us, p999 " << m.p999_us << " us";
+                if (m.mean_settled)
+                    std::cout << ", " << *m.mean_settled << " settled";
+                std::cout << ", " << m.memory_bytes/1024 << " KiB" << std::endl;
+            }
+        }
+    }
+    write_json(json_file, seed, results);
+    if (!trace_file.empty())
+        trace::write_chrome_trace(trace_file);
+    return EXIT_SUCCESS;
+}
@@ -1,4 +1,8 @@
 #include "submission/shortest_paths.h"
+#include "submission/city_graph.h"
+#include "submission/distance_oracle.h"
+#include "submission/compact_graph.h"
+#include "submission/versioned_graph.h"
 
 #include <algorithm>
 #include <cmath>
@@ -12,97 +16,19 @@
 #include <array>
 #include <cassert>
 #include <string>
+#include <vector>
 #include <stdexcept>
 
 int main() {
 
-    ShortestPaths graph;
-
-    // load cities
-    {
-        // data taken from https://simplemaps.com/data/de-cities
-        std::ifstream city_data("../de.csv", std::ifstream::in);
-        char buffer[1024];
-
-        // determine number of lines in the file
-        size_t num_cities = 0;
-        // skip header
-        city_data.getline(buffer, std::size(buffer));
-        while (!city_data.eof()) {
-            city_data.getline(buffer, std::size(buffer));
-            if (buffer[0]) // ignore empty line at the end
-                ++num_cities;
-        }
-        graph.resize(num_cities);
-        // reset flags
-        city_data.clear();
-        // rewind file
-        city_data.seekg(0, std::ifstream::beg);
-
-        // skip header
-        city_data.getline(buffer, std::size(buffer));
-        for (size_t i=0; i<graph.size(); ++i) {
-            if (!city_data.getline(buffer, std::size(buffer)))
-                break;
-
-            std::string line {buffer, std::size(buffer)-1};
-
-            size_t first_comma = line.find_first_of(',');
-            if (first_comma == std::string::npos)
-                break;
-            size_t second_comma = line.find_first_of(',', first_comma+1);
-            if (second_comma == std::string::npos)
-                break;
-            size_t third_comma = line.find_first_of(',', second_comma+1);
-            if (third_comma == std::string::npos)
-                break;
-
-            graph[i].name = line.substr(0, first_comma);
-            const float lat = std::stof(line.substr(first_comma+1, second_comma-first_comma));
-            const float lon = std::stof(line.substr(second_comma+1, third_comma-second_comma));
-
-            const float theta = (90.0f-lat)*float(M_PI/180.0);
-            const float phi = lon*float(M_PI/180.0);
-
-            // approximate radius of the earth in kilometers
-            constexpr const float r = 6378.137f;
-            // reference location for (0, 0)
-            constexpr float ref_lat = 48.5200f;
-            constexpr float ref_lon = 9.0556f;
-
-            constexpr float ref_theta = (90.0f-ref_lat)*float(M_PI/180.0);
-            constexpr float ref_phi = ref_lon*float(M_PI/180.0);
-
-            // produce some approximate values that produce plausible distances in kilometers
-            graph[i].pos_x = (phi-ref_phi) * std::cos(ref_theta)*r;
-            graph[i].pos_y = (theta-ref_theta) * r;
-        }
-        city_data.close();
-    }
-
+    // data taken from https://simplemaps.com/data/de-cities
+    ShortestPaths graph = load_cities("../de.csv");
     // add edges between k closest cities
-    {
-        const size_t nearest_k = 5;
-        if (nearest_k > graph.size())
-            throw std::runtime_error("not enough data for knn");
+    connect_nearest(graph, 5);
 
-        auto distance = [](const ShortestPaths::Location& a, const ShortestPaths::Location& b) -> float { return std::sqrt((a.pos_x-b.pos_x)*(a.pos_x-b.pos_x)+(a.pos_y-b.pos_y)*(a.pos_y-b.pos_y)); };
-        for (size_t i=0; i<graph.size(); ++i) {
-            std::vector<std::tuple<float, size_t>> nearest_neighbors;
-            for (size_t j=0; j<graph.size(); ++j) {
-                if (j == i)
-                    continue;
-                nearest_neighbors.emplace_back(distance(graph.at(i), graph.at(j)), j);
-            }
-            std::nth_element(nearest_neighbors.begin(), nearest_neighbors.begin()+nearest_k, nearest_neighbors.end(), [](const auto& a, const auto& b) -> bool { return std::get<0>(a) < std::get<0>(b); });
-
-            // add edges between nearest k elements in both directions
-            for (size_t j=0; j<nearest_k; ++j) {
-                graph[i][std::get<1>(nearest_neighbors.at(j))] = std::get<0>(nearest_neighbors.at(j));
-                graph[std::get<1>(nearest_neighbors.at(j))][i] = std::get<0>(nearest_neighbors.at(j));
-            }
-        }
-    }
+    graph.build_spatial_index();
+    // load_cities places the cities relative to a reference location in southern Germany, which is at (0, 0)
+    std::cout << "Closest city to the reference location: " << graph.at(graph.nearest_node(0.0f, 0.0f)).name << std::endl;
 
     // TODO: this is where you can test your code
     // Stuttgart - Ulm should be about 90 km
@@ -121,5 +47,52 @@ int main() {
     else
         std::cout << "No route found!" << std::endl;
 
+    const auto routes = graph.compute_alternatives("Berlin", "Munich");
+    for (size_t r=1; r<routes.size(); ++r) {
+        std::cout << "Alternative " << r << " (" << routes[r].length << " km): ";
+        for (size_t i=0; i<routes[r].path.size()-1; ++i)
+            std::cout << graph.at(routes[r].path[i]).name << " - ";
+        std::cout << graph.at(routes[r].path.back()).name << std::endl;
+    }
+
+    {
+        std::vector<size_t> ports;
+        for (const char* city : {"Hamburg", "Bremen", "Kiel", "Rostock"})
+            ports.push_back(graph.getNodeIdByName(city));
+        const auto nearest = graph.compute_shortest_path_to_any(graph.getNodeIdByName("Stuttgart"), ports);
+        if (!nearest.path.empty())
+            std::cout << "Closest port to Stuttgart: " << graph.at(nearest.path.back()).name << " (" << nearest.length << " km)" << std::endl;
+    }
+
+    {
+        // close the first road of the Stuttgart - Ulm route while a reader still uses the old version
+        VersionedGraph live(graph);
+        const size_t stuttgart = graph.getNodeIdByName("Stuttgart");
+        const size_t ulm = graph.getNodeIdByName("Ulm");
+        const auto before = live.read();
+        const auto route = before->compute_shortest_path(stuttgart, ulm);
+        const std::vector<VersionedGraph::EdgeChange> closure {{route.path[0], route.path[1], std::nullopt}, {route.path[1], route.path[0], std::nullopt}};
+        live.publish(closure);
+        std::cout << "Stuttgart - Ulm: " << before->compute_shortest_path(stuttgart, ulm).length << " km in version " << before->number()
+                  << ", " << live.read()->compute_shortest_path(stuttgart, ulm).length << " km after closing " << graph.at(route.path[1]).name << std::endl;
+    }
+
+    for (unsigned k : {2u, 3u}) {
+        const DistanceOracle oracle(graph, k);
+        const auto stats = oracle.build_stats();
+        const auto stretch = oracle.measure_stretch(10000);
+        std::cout << "Distance oracle k=" << k << ": " << stats.build_seconds*1000.0 << " ms, "
+                  << stats.memory_bytes/1024 << " KiB, stretch mean " << stretch.mean << " p99 " << stretch.p99
+                  << " max " << stretch.max << ", Berlin - Munich ~" << oracle.distance(graph.getNodeIdByName("Berlin"), graph.getNodeIdByName("Munich")) << " km" << std::endl;
+    }
+
+    {
+        const auto compact = CompactGraph<uint16_t>::from(graph);
+        const auto berlin = static_cast<uint32_t>(graph.getNodeIdByName("Berlin"));
+        const auto munich = static_cast<uint32_t>(graph.getNodeIdByName("Munich"));
+        std::cout << "Compact graph: " << compact.memory_bytes()/1024 << " KiB, unit " << compact.unit()
+                  << " km, Berlin - Munich " << compact.distance(berlin, munich) << " km" << std::endl;
+    }
+
     return EXIT_SUCCESS;
 }
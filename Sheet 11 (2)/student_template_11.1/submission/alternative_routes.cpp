@@ -0,0 +1,469 @@
+#include "shortest_paths.h"
+#include "search_kernel.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    /// The edges that the forward search of compute_alternatives scanned, i.e. all edges leaving the nodes it settled,
+    /// kept for the other searches of the call: a row of the adjacency matrix costs a pass over all nodes, a kept
+    /// list only the degree of the node, and the incoming edges need no pass over a column of the matrix.
+    class ScannedEdges {
+    public:
+        void clear(size_t num_nodes)
+        {
+            ranges.assign(num_nodes, {not_scanned, not_scanned});
+            targets.clear();
+            weights.clear();
+        }
+
+        /// Edges policy that scans the rows of graph like search::OutgoingEdges and keeps their edges
+        auto recording(const ShortestPaths& graph)
+        {
+            return [this, &graph](size_t u, auto&& visit) {
+                ranges[u].first = targets.size();
+                search::OutgoingEdges{graph}(u, [&](size_t v, float weight) {
+                    targets.push_back(v);
+                    weights.push_back(weight);
+                    visit(v, weight);
+                });
+                ranges[u].second = targets.size();
+            };
+        }
+
+        /// builds the incoming edge lists from the kept edges, as compressed sparse rows
+        void build_incoming()
+        {
+            const size_t num_nodes = ranges.size();
+            in_offsets.assign(num_nodes+1, 0);
+            for (size_t v : targets)
+                ++in_offsets[v+1];
+            for (size_t v=0; v<num_nodes; ++v)
+                in_offsets[v+1] += in_offsets[v];
+            in_sources.resize(targets.size());
+            in_weights.resize(targets.size());
+            // in_offsets[v] moves to the end of the edges into v while they are filled in and back to their begin after
+            for (size_t u=0; u<num_nodes; ++u) {
+                if (ranges[u].first == not_scanned)
+                    continue;
+                for (size_t e=ranges[u].first; e<ranges[u].second; ++e) {
+                    const size_t position = in_offsets[targets[e]]++;
+                    in_sources[position] = u;
+                    in_weights[position] = weights[e];
+                }
+            }
+            for (size_t v=num_nodes; v>0; --v)
+                in_offsets[v] = in_offsets[v-1];
+            in_offsets[0] = 0;
+        }
+
+        /// calls visit(v, weight) for every edge u->v, from the kept edges if u was scanned and from graph otherwise
+        template <typename Visitor>
+        void outgoing(const ShortestPaths& graph, size_t u, Visitor&& visit) const
+        {
+            const auto [begin, end] = ranges[u];
+            if (begin == not_scanned)
+                search::OutgoingEdges{graph}(u, visit);
+            else
+                for (size_t e=begin; e<end; ++e)
+                    visit(targets[e], weights[e]);
+        }
+
+        /// calls visit(v, weight) for every kept edge v->u (see build_incoming)
+        template <typename Visitor>
+        void incoming(size_t u, Visitor&& visit) const
+        {
+            for (size_t e=in_offsets[u]; e<in_offsets[u+1]; ++e)
+                visit(in_sources[e], in_weights[e]);
+        }
+
+    private:
+        static constexpr size_t not_scanned = SIZE_MAX;
+
+        /// for every node the range of its edges in targets and weights, not_scanned if the search did not scan it
+        std::vector<std::pair<size_t, size_t>> ranges;
+        std::vector<size_t> targets;
+        std::vector<float> weights;
+        /// the edges into v are [in_offsets[v], in_offsets[v+1]) of in_sources and in_weights
+        std::vector<size_t> in_offsets;
+        std::vector<size_t> in_sources;
+        std::vector<float> in_weights;
+    };
+
+    /// the interface of ScannedEdges over prebuilt adjacency lists, which already hold all edges in both directions
+    class ListedEdges {
+    public:
+        explicit ListedEdges(const search::AdjacencyLists& l) : lists(l) {}
+
+        void clear(size_t) {}
+        auto recording(const ShortestPaths&) const { return search::ListedOutgoingEdges(lists); }
+        void build_incoming() {}
+        template <typename Visitor>
+        void outgoing(const ShortestPaths&, size_t u, Visitor&& visit) const { lists.outgoing(u, visit); }
+        template <typename Visitor>
+        void incoming(size_t u, Visitor&& visit) const { lists.incoming(u, visit); }
+
+    private:
+        const search::AdjacencyLists& lists;
+    };
+
+    /// A* for the local optimality tests and the penalty method, which run many times per call. Unlike search::run,
+    /// it resets only the entries it touched, so a search costs the nodes it reaches and not a pass over all nodes.
+    class LocalSearch {
+    public:
+        /// distance from source to target (INFINITY if unreachable) with the given edges; the heuristic has to be
+        /// consistent
+        template <typename Heuristic, typename Edges>
+        float run(size_t num_nodes, size_t source, size_t target, const Heuristic& heuristic, const Edges& edges)
+        {
+            clear(num_nodes);
+            dists[source] = 0.0f;
+            touched.push_back(source);
+            search::BinaryHeap::push(queue, {heuristic(source), source});
+            while (!queue.empty()) {
+                const size_t u = search::BinaryHeap::pop(queue).second;
+                if (settled[u])
+                    continue;
+                settled[u] = true;
+                if (u == target)
+                    break;
+                const float dist = dists[u];
+                edges(u, [&](size_t v, float weight) {
+                    const float new_dist = dist+weight;
+                    if (!settled[v] && new_dist < dists[v]) {
+                        if (dists[v] == INFINITY)
+                            touched.push_back(v);
+                        dists[v] = new_dist;
+                        predecessors[v] = u;
+                        search::BinaryHeap::push(queue, {new_dist+heuristic(v), v});
+                    }
+                });
+            }
+            return dists[target];
+        }
+
+        /// the path from the source of the last search to target, empty if target was not reached
+        std::vector<size_t> path(size_t target) const
+        {
+            std::vector<size_t> result;
+            if (dists[target] == INFINITY)
+                return result;
+            for (size_t node = target; node != no_node; node = predecessors[node])
+                result.push_back(node);
+            std::reverse(result.begin(), result.end());
+            return result;
+        }
+
+    private:
+        static constexpr size_t no_node = SIZE_MAX;
+
+        void clear(size_t num_nodes)
+        {
+            if (dists.size() != num_nodes) {
+                dists.assign(num_nodes, INFINITY);
+                predecessors.assign(num_nodes, no_node);
+                settled.assign(num_nodes, false);
+                touched.clear();
+            }
+            for (size_t v : touched) {
+                dists[v] = INFINITY;
+                predecessors[v] = no_node;
+                settled[v] = false;
+            }
+            touched.clear();
+            queue.clear();
+        }
+
+        std::vector<float> dists;
+        std::vector<size_t> predecessors;
+        std::vector<bool> settled;
+        std::vector<size_t> touched;
+        std::vector<std::pair<float, size_t>> queue;
+    };
+
+    /// all searches for one compute_alternatives call share this memory; it is kept per thread across calls
+    struct AlternativesWorkspace {
+        ShortestPaths::SearchWorkspace forward;
+        ShortestPaths::SearchWorkspace backward;
+        /// used for the local optimality checks and the penalty searches
+        LocalSearch local;
+        /// the edges of the call if the graph has no adjacency lists
+        ScannedEdges scanned;
+    };
+
+    /// appends the tree path from the root of the search to node; forward trees yield root..node,
+    /// backward trees node..root (in both cases in the direction of travel)
+    template <bool Forward>
+    void append_tree_path(const ShortestPaths::SearchWorkspace& ws, size_t node, std::vector<size_t>& path)
+    {
+        const size_t begin = path.size();
+        for (std::optional<size_t> elem = node; elem; elem = ws.predecessors[*elem])
+            path.push_back(*elem);
+        if constexpr (Forward)
+            std::reverse(path.begin()+static_cast<std::ptrdiff_t>(begin), path.end());
+    }
+
+    float path_length(const ShortestPaths& graph, const std::vector<size_t>& path)
+    {
+        float length = 0.0f;
+        for (size_t i=1; i<path.size(); ++i)
+            length += *graph.internal_node(path[i-1]).row()[path[i]];
+        return length;
+    }
+
+    bool is_simple(const std::vector<size_t>& path, std::vector<bool>& seen)
+    {
+        bool simple = true;
+        for (size_t node : path) {
+            if (seen[node])
+                simple = false;
+            seen[node] = true;
+        }
+        for (size_t node : path)
+            seen[node] = false;
+        return simple;
+    }
+
+    uint64_t edge_key(size_t from, size_t to) { return (static_cast<uint64_t>(from) << 32) | static_cast<uint64_t>(to); }
+
+    /// checks the acceptance criteria of an alternative route and appends it to routes if it passes; Edges is
+    /// ScannedEdges or ListedEdges
+    template <typename Edges>
+    class AlternativeFilter {
+    public:
+        AlternativeFilter(const ShortestPaths& g, const ShortestPaths::AlternativeOptions& opts, AlternativesWorkspace& workspace, const Edges& e, std::vector<ShortestPaths::Route>& accepted)
+            : graph(g), options(opts), ws(workspace), kept(e), routes(accepted), seen(g.size(), false), on_route(g.size(), false)
+        {
+            add_route(routes.front());
+        }
+
+        /// via is the index of the via node in path for routes of the via-node method, routes of the penalty method
+        /// have none
+        bool try_accept(std::vector<size_t>&& path, std::optional<size_t> via)
+        {
+            const float optimal = routes.front().length;
+            if (path.size() < 2 || !is_simple(path, seen))
+                return false;
+
+            // bounded stretch
+            const float length = path_length(graph, path);
+            if (length > options.max_stretch*optimal)
+                return false;
+
+            // limited sharing with the optimal route and all alternatives accepted so far
+            float shared = 0.0f;
+            for (size_t i=1; i<path.size(); ++i)
+                if (is_route_edge(path[i-1], path[i]))
+                    shared += *graph.internal_node(path[i-1]).row()[path[i]];
+            if (shared > options.max_sharing*optimal)
+                return false;
+
+            ++num_local_tests;
+            if (!is_locally_optimal(path, via ? *via : deviation_point(path)))
+                return false;
+
+            routes.push_back({std::move(path), length});
+            add_route(routes.back());
+            return true;
+        }
+
+        /// whether u->v is an edge of an accepted route; the node mask spares the hash lookup for most edges
+        bool is_route_edge(size_t u, size_t v) const { return on_route[u] && route_edges.count(edge_key(u, v)); }
+        size_t local_tests() const { return num_local_tests; }
+
+    private:
+        /// index of the first node of path from which the route leaves the edges of the accepted routes
+        size_t deviation_point(const std::vector<size_t>& path) const
+        {
+            size_t deviation = 0;
+            while (deviation+1 < path.size() && is_route_edge(path[deviation], path[deviation+1]))
+                ++deviation;
+            return deviation;
+        }
+
+        /// T-test: every subpath that is at most options.local_optimality*optimal long has to be a shortest path.
+        /// Tests the subpath reaching threshold from path[center] in both directions; center is the via node for
+        /// via-node routes (both halves are shortest paths, so only a subpath across it can be a detour) and the
+        /// deviation point for routes of the penalty method.
+        bool is_locally_optimal(const std::vector<size_t>& path, size_t center)
+        {
+            const float threshold = options.local_optimality*routes.front().length;
+
+            size_t first = center;
+            float before = 0.0f;
+            while (first > 0 && before < threshold) {
+                before += *graph.internal_node(path[first-1]).row()[path[first]];
+                --first;
+            }
+            size_t last = center;
+            float after = 0.0f;
+            while (last+1 < path.size() && after < threshold) {
+                after += *graph.internal_node(path[last]).row()[path[last+1]];
+                ++last;
+            }
+
+            const size_t target = path[last];
+            const auto edges = [&](size_t u, auto&& visit) { kept.outgoing(graph, u, visit); };
+            const float dist = ws.local.run(graph.size(), path[first], target, search::EuclideanHeuristic(graph, target), edges);
+            // allow for rounding differences of the float sums
+            return dist >= (before+after)*(1.0f-1e-5f);
+        }
+
+        void add_route(const ShortestPaths::Route& route)
+        {
+            for (size_t i=1; i<route.path.size(); ++i) {
+                route_edges.insert(edge_key(route.path[i-1], route.path[i]));
+                on_route[route.path[i-1]] = true;
+            }
+        }
+
+        const ShortestPaths& graph;
+        const ShortestPaths::AlternativeOptions& options;
+        AlternativesWorkspace& ws;
+        const Edges& kept;
+        std::vector<ShortestPaths::Route>& routes;
+        std::unordered_set<uint64_t> route_edges;
+        std::vector<bool> seen;
+        std::vector<bool> on_route;
+        size_t num_local_tests = 0;
+    };
+
+    /// compute_alternatives on internal ids with the edges of kept (ScannedEdges or ListedEdges)
+    template <typename Edges>
+    std::vector<ShortestPaths::Route> find_alternatives(const ShortestPaths& graph, size_t from, size_t to, const ShortestPaths::AlternativeOptions& options,
+                                                        AlternativesWorkspace& ws, Edges& kept)
+    {
+        using Route = ShortestPaths::Route;
+        std::vector<Route> routes;
+        const size_t num_nodes = graph.size();
+        search::NoStats stats;
+
+        // One forward and one backward shortest-path tree give the optimal route and all via-node candidates. Every node
+        // v of an acceptable route has d(from, v)+d(v, to) <= options.max_stretch*optimal, so both trees are A* searches
+        // with the straight-line distance that stop once the key d+h exceeds that bound: they settle the nodes of
+        // acceptable routes (with exact distances) but not the whole ball around their roots. The nodes within the bound
+        // of the forward tree also contain all nodes on the shortest paths from candidates to to, so the backward search
+        // only needs the edges leaving them, which the forward search scans anyway; it keeps them instead of scanning a
+        // column of the matrix for every node. All further searches take the kept edges as well.
+        kept.clear(num_nodes);
+        const auto forward_done = [&](size_t node) {
+            return ws.forward.visited[to] && ws.forward.dists[node]+ws.forward.heuristics[node] > options.max_stretch*ws.forward.dists[to];
+        };
+        search::run(ws.forward, num_nodes, from, forward_done, search::EuclideanHeuristic(graph, to), stats, kept.recording(graph));
+        if (!ws.forward.visited[to])
+            return routes;
+
+        const float optimal = ws.forward.dists[to];
+        const float bound = options.max_stretch*optimal;
+        {
+            TRACE_SCOPE("backward tree");
+            kept.build_incoming();
+            const auto backward_done = [&](size_t node) { return ws.backward.dists[node]+ws.backward.heuristics[node] > bound; };
+            const auto incoming_edges = [&](size_t u, auto&& visit) { kept.incoming(u, visit); };
+            search::run(ws.backward, num_nodes, to, backward_done, search::EuclideanHeuristic(graph, from), stats, incoming_edges);
+        }
+        {
+            Route route;
+            append_tree_path<true>(ws.forward, to, route.path);
+            route.length = optimal;
+            routes.push_back(std::move(route));
+        }
+        if (from == to || options.max_alternatives == 0)
+            return routes;
+
+        AlternativeFilter<Edges> filter(graph, options, ws, kept, routes);
+
+        // 1. via-node method: s -> v -> t for nodes v that lie on neither tree path of the optimal route
+        {
+            TRACE_SCOPE("via-node candidates");
+            std::vector<std::pair<float, size_t>> candidates;
+            for (size_t v=0; v<num_nodes; ++v) {
+                if (!ws.forward.visited[v] || !ws.backward.visited[v])
+                    continue;
+                const float length = ws.forward.dists[v]+ws.backward.dists[v];
+                if (length <= bound && length > optimal*(1.0f+1e-5f))
+                    candidates.emplace_back(length, v);
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            // candidates on an already accepted route are skipped without building their path
+            std::vector<bool> covered(num_nodes, false);
+            const auto cover = [&](const Route& route) { for (size_t node : route.path) covered[node] = true; };
+            cover(routes.front());
+            for (const auto& [length, via] : candidates) {
+                if (routes.size() > options.max_alternatives || filter.local_tests() >= options.max_local_tests)
+                    break;
+                if (covered[via])
+                    continue;
+                std::vector<size_t> path;
+                append_tree_path<true>(ws.forward, via, path);
+                path.pop_back();
+                const size_t via_index = path.size();
+                append_tree_path<false>(ws.backward, via, path);
+                if (filter.try_accept(std::move(path), via_index))
+                    cover(routes.back());
+            }
+            TRACE_COUNTER("via-node candidates", candidates.size());
+            TRACE_COUNTER("local optimality tests", filter.local_tests());
+        }
+
+        // 2. penalty method: search again with increasingly penalized weights on the edges of all accepted routes
+        {
+            TRACE_SCOPE("penalty method");
+            constexpr float penalty_step = 0.25f;
+            const size_t max_penalty_rounds = 2*options.max_alternatives;
+            float penalty = 1.0f;
+            for (size_t round=0; round<max_penalty_rounds && routes.size() <= options.max_alternatives; ++round) {
+                penalty += penalty_step;
+                const auto penalized_edges = [&](size_t u, auto&& visit) {
+                    kept.outgoing(graph, u, [&](size_t v, float weight) {
+                        visit(v, filter.is_route_edge(u, v) ? weight*penalty : weight);
+                    });
+                };
+                // the penalties only lengthen edges, so the straight-line distance stays consistent
+                ws.local.run(num_nodes, from, to, search::EuclideanHeuristic(graph, to), penalized_edges);
+                filter.try_accept(ws.local.path(to), std::nullopt);
+            }
+        }
+
+        return routes;
+    }
+}
+
+std::vector<ShortestPaths::Route> ShortestPaths::compute_alternatives(size_t from, size_t to, const AlternativeOptions& options) const
+{
+    TRACE_SCOPE("compute_alternatives");
+    if (from >= size() || to >= size())
+        throw std::out_of_range("node id out of range");
+    thread_local AlternativesWorkspace ws;
+    std::vector<Route> routes = find_alternatives(*this, to_internal(from), to_internal(to), options, ws, ws.scanned);
+    for (Route& route : routes)
+        for (size_t& node : route.path)
+            node = to_external(node);
+    return routes;
+}
+
+std::vector<ShortestPaths::Route> ShortestPaths::compute_alternatives(size_t from, size_t to, const AlternativeOptions& options, const search::AdjacencyLists& lists) const
+{
+    TRACE_SCOPE("compute_alternatives");
+    if (from >= size() || to >= size())
+        throw std::out_of_range("node id out of range");
+    if (lists.size() != size())
+        throw std::invalid_argument("the adjacency lists belong to a different graph");
+    thread_local AlternativesWorkspace ws;
+    ListedEdges kept(lists);
+    std::vector<Route> routes = find_alternatives(*this, to_internal(from), to_internal(to), options, ws, kept);
+    for (Route& route : routes)
+        for (size_t& node : route.path)
+            node = to_external(node);
+    return routes;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <ios>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/// helpers for the binary snapshot files - values are stored in host byte order with fixed-width types
+namespace binary_io {
+
+    template <typename T>
+    void write_value(std::ostream& stream, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be written directly");
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /// number of bytes between the current position and the end of the stream, the maximum if the stream cannot seek;
+    /// sizes read from a file are checked against it before anything is allocated for them
+    inline uint64_t remaining_bytes(std::istream& stream)
+    {
+        const std::streampos position = stream.tellg();
+        if (position < 0)
+            return std::numeric_limits<uint64_t>::max();
+        stream.seekg(0, std::ios::end);
+        const std::streampos end = stream.tellg();
+        stream.seekg(position);
+        if (end < position)
+            return std::numeric_limits<uint64_t>::max();
+        return static_cast<uint64_t>(end-position);
+    }
+
+    template <typename T>
+    T read_value(std::istream& stream)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be read directly");
+        T value;
+        if (!stream.read(reinterpret_cast<char*>(&value), sizeof(T)))
+            throw std::runtime_error("unexpected end of snapshot");
+        return value;
+    }
+
+    /// writes the number of elements followed by all elements in one block
+    template <typename T>
+    void write_array(std::ostream& stream, const std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be written directly");
+        write_value<uint64_t>(stream, values.size());
+        stream.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(sizeof(T)*values.size()));
+    }
+
+    template <typename T>
+    std::vector<T> read_array(std::istream& stream)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable types can be read directly");
+        const auto size = read_value<uint64_t>(stream);
+        if (size > remaining_bytes(stream)/sizeof(T))
+            throw std::runtime_error("array size exceeds the rest of the snapshot");
+        std::vector<T> values(size);
+        if (!stream.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(sizeof(T)*values.size())))
+            throw std::runtime_error("unexpected end of snapshot");
+        return values;
+    }
+}
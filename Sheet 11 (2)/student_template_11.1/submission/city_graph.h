@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "shortest_paths.h"
+
+/// loads the cities of a simplemaps csv file (city,lat,lng,...) with positions in approximate kilometers
+/// relative to a reference location in southern Germany; the graph has no edges yet
+ShortestPaths load_cities(const std::string& filename);
+
+/// num_nodes locations uniformly distributed in a width x height rectangle (in kilometers), no edges
+ShortestPaths random_locations(size_t num_nodes, float width, float height, uint64_t seed);
+
+/// adds edges in both directions between each node and its nearest_k closest nodes, weighted by their distance
+void connect_nearest(ShortestPaths& graph, size_t nearest_k);
@@ -0,0 +1,203 @@
+#include "compact_graph.h"
+#include "binary_io.h"
+#include "routing_snapshot.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+template <typename TWeight>
+CompactGraph<TWeight>::CompactGraph(const std::vector<uint64_t>& offsets, const std::vector<uint32_t>& targets, const std::vector<float>& weights, float unit)
+{
+    if (offsets.empty() || offsets.front() != 0 || offsets.back() != targets.size() || targets.size() != weights.size()
+        || !std::is_sorted(offsets.begin(), offsets.end()))
+        throw std::invalid_argument("inconsistent compressed sparse rows");
+    if (offsets.size()-1 >= no_node || targets.size() > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("graph too large for 32 bit ids");
+
+    const float max_input = weights.empty() ? 0.0f : *std::max_element(weights.begin(), weights.end());
+    if (!weights.empty() && (*std::min_element(weights.begin(), weights.end()) < 0.0f || !std::isfinite(max_input)))
+        throw std::invalid_argument("edge weights have to be finite and non-negative");
+    weight_unit = choose_unit(unit, max_input, offsets.size()-1);
+
+    edge_offsets.assign(offsets.begin(), offsets.end());
+    edge_targets = targets;
+    const uint32_t num_nodes = static_cast<uint32_t>(offsets.size()-1);
+    for (uint32_t target : edge_targets)
+        if (target >= num_nodes)
+            throw std::out_of_range("edge target out of range");
+    edge_weights.reserve(weights.size());
+    for (float weight : weights)
+        edge_weights.push_back(quantize(weight));
+}
+
+template <typename TWeight>
+float CompactGraph<TWeight>::choose_unit(float unit, float max_input, size_t num_nodes)
+{
+    if (unit <= 0.0f)
+        unit = max_input > 0.0f ? std::max(max_input/static_cast<float>(max_weight), max_input*static_cast<float>(num_nodes+1)/4294967295.0f) : 1.0f;
+    if (std::round(max_input/unit) > static_cast<float>(max_weight))
+        throw std::range_error("largest edge weight does not fit into the quantized range");
+    return unit;
+}
+
+template <typename TWeight>
+CompactGraph<TWeight> CompactGraph<TWeight>::from(const ShortestPaths& graph, float unit)
+{
+    const size_t num_nodes = graph.size();
+    std::vector<uint64_t> offsets {0};
+    std::vector<uint32_t> targets;
+    std::vector<float> weights;
+    offsets.reserve(num_nodes+1);
+    for (size_t u=0; u<num_nodes; ++u) {
+        const auto& row = graph.internal_node(u).row();
+        for (size_t v=0; v<num_nodes; ++v) {
+            if (row[v]) {
+                targets.push_back(static_cast<uint32_t>(v));
+                weights.push_back(*row[v]);
+            }
+        }
+        offsets.push_back(targets.size());
+    }
+
+    CompactGraph compact(offsets, targets, weights, unit);
+    compact.pos_x.reserve(num_nodes);
+    compact.pos_y.reserve(num_nodes);
+    std::vector<uint32_t> ids(num_nodes);
+    bool reordered = false;
+    for (size_t u=0; u<num_nodes; ++u) {
+        compact.pos_x.push_back(graph.internal_node(u).pos_x);
+        compact.pos_y.push_back(graph.internal_node(u).pos_y);
+        ids[u] = static_cast<uint32_t>(graph.to_external(u));
+        reordered = reordered || ids[u] != u;
+    }
+    if (reordered)
+        compact.set_external_ids(std::move(ids));
+    return compact;
+}
+
+template <typename TWeight>
+CompactGraph<TWeight> CompactGraph<TWeight>::load_snapshot(const std::string& filename, float unit)
+{
+    std::ifstream file(filename, std::ifstream::in|std::ifstream::binary);
+    if (!file)
+        throw std::runtime_error("cannot open "+filename);
+
+    const size_t num_nodes = routing_snapshot::read_header(file);
+    for (size_t i=0; i<num_nodes; ++i)
+        file.ignore(binary_io::read_value<uint32_t>(file));
+    auto xs = binary_io::read_array<float>(file);
+    auto ys = binary_io::read_array<float>(file);
+    if (xs.size() != num_nodes || ys.size() != num_nodes)
+        throw std::runtime_error("corrupt node positions in "+filename);
+
+    CompactGraph compact;
+    {
+        const auto offsets = binary_io::read_array<uint64_t>(file);
+        const auto targets = binary_io::read_array<uint32_t>(file);
+        const auto weights = binary_io::read_array<float>(file);
+        if (offsets.size() != num_nodes+1)
+            throw std::runtime_error("corrupt edges in "+filename);
+        compact = CompactGraph(offsets, targets, weights, unit);
+    }
+    compact.pos_x = std::move(xs);
+    compact.pos_y = std::move(ys);
+    auto ids = binary_io::read_array<uint32_t>(file);
+    if (!ids.empty())
+        compact.set_external_ids(std::move(ids));
+    return compact;
+}
+
+template <typename TWeight>
+void CompactGraph<TWeight>::set_external_ids(std::vector<uint32_t> ids)
+{
+    if (ids.size() != size())
+        throw std::invalid_argument("id map does not match the number of nodes");
+    internal_ids.assign(ids.size(), no_node);
+    for (uint32_t i=0; i<ids.size(); ++i) {
+        if (ids[i] >= ids.size() || internal_ids[ids[i]] != no_node)
+            throw std::invalid_argument("id map is not a permutation");
+        internal_ids[ids[i]] = i;
+    }
+    external_ids = std::move(ids);
+}
+
+template <typename TWeight>
+size_t CompactGraph<TWeight>::memory_bytes() const
+{
+    return sizeof(uint32_t)*(edge_offsets.size()+edge_targets.size()+external_ids.size()+internal_ids.size())
+         + sizeof(TWeight)*edge_weights.size()
+         + sizeof(float)*(pos_x.size()+pos_y.size());
+}
+
+template <typename TWeight>
+void CompactGraph<TWeight>::search(Workspace& ws, uint32_t from, uint32_t to) const
+{
+    TRACE_SCOPE("compact search");
+    const uint32_t num_nodes = static_cast<uint32_t>(size());
+    if (from >= num_nodes || to >= num_nodes)
+        throw std::out_of_range("node id out of range");
+    ws.dists.assign(num_nodes, std::numeric_limits<uint32_t>::max());
+    ws.predecessors.assign(num_nodes, no_node);
+    ws.visited.assign(num_nodes, false);
+    ws.queue.clear();
+
+    // the packed entries compare by distance first, so a plain integer heap suffices
+    const auto compare = std::greater<uint64_t>{};
+    ws.dists[from] = 0;
+    ws.queue.push_back(from);
+    while (!ws.queue.empty()) {
+        std::pop_heap(ws.queue.begin(), ws.queue.end(), compare);
+        const auto elem = static_cast<uint32_t>(ws.queue.back());
+        ws.queue.pop_back();
+        if (ws.visited[elem])
+            continue;
+        ws.visited[elem] = true;
+        if (elem == to)
+            break;
+
+        const uint32_t dist = ws.dists[elem];
+        for (uint32_t e=edge_offsets[elem]; e<edge_offsets[elem+1]; ++e) {
+            const uint32_t i = edge_targets[e];
+            const uint64_t new_dist = static_cast<uint64_t>(dist)+static_cast<uint32_t>(edge_weights[e]);
+            if (new_dist >= std::numeric_limits<uint32_t>::max())
+                throw std::overflow_error("path length exceeds the 32 bit distance range, use a coarser unit");
+            if (!ws.visited[i] && new_dist < ws.dists[i]) {
+                ws.dists[i] = static_cast<uint32_t>(new_dist);
+                ws.predecessors[i] = elem;
+                ws.queue.push_back(new_dist << 32 | i);
+                std::push_heap(ws.queue.begin(), ws.queue.end(), compare);
+            }
+        }
+    }
+}
+
+template <typename TWeight>
+std::vector<uint32_t> CompactGraph<TWeight>::compute_shortest_path(uint32_t from, uint32_t to) const
+{
+    thread_local Workspace ws;
+    const uint32_t target = to_internal(to);
+    search(ws, to_internal(from), target);
+
+    std::vector<uint32_t> path;
+    if (!ws.visited[target])
+        return path;
+    for (uint32_t elem = target; elem != no_node; elem = ws.predecessors[elem])
+        path.push_back(to_external(elem));
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+template <typename TWeight>
+float CompactGraph<TWeight>::distance(uint32_t from, uint32_t to) const
+{
+    thread_local Workspace ws;
+    const uint32_t target = to_internal(to);
+    search(ws, to_internal(from), target);
+    return ws.visited[target] ? static_cast<float>(ws.dists[target])*weight_unit : INFINITY;
+}
+
+template class CompactGraph<uint16_t>;
+template class CompactGraph<uint24>;
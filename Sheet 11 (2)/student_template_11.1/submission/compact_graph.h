@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "shortest_paths.h"
+
+/// unsigned 24 bit integer stored in three bytes (no padding, alignment 1)
+struct uint24 {
+    std::array<uint8_t, 3> bytes {};
+
+    static constexpr uint32_t max() { return 0xffffff; }
+
+    constexpr uint24() = default;
+    constexpr uint24(uint32_t value)
+        : bytes{static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value >> 16)} {}
+    constexpr operator uint32_t() const {
+        return static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 | static_cast<uint32_t>(bytes[2]) << 16;
+    }
+};
+static_assert(sizeof(uint24) == 3, "uint24 must not be padded");
+
+/// options of CompactGraph::load_edge_list
+struct EdgeListOptions {
+    /// adds every edge in both directions
+    bool bidirectional = false;
+    /// parser threads, 0 for one per hardware thread
+    size_t num_threads = 0;
+    /// bytes read from a file at once, bounds the memory of the text; lines must be shorter
+    size_t block_size = 16 << 20;
+    /// weight unit, 0 picks it automatically
+    float unit = 0.0f;
+};
+
+/// Memory-reduced read-only routing graph: 32 bit node ids, compressed sparse rows and edge weights quantized to
+/// TWeight (uint16_t or uint24) in a fixed-point unit that is chosen per graph.
+///
+/// Exactness: every weight w is stored as q = round(w/unit), so |q*unit - w| <= unit/2 for each edge. The length of a
+/// path with k edges is off by at most k*unit/2, and the path returned by compute_shortest_path is at most
+/// (k* + k')*unit/2 longer than the true shortest path, where k* and k' are the edge counts of the true and the
+/// returned path. If all weights are multiples of unit (e.g. integer meters with unit 1), results are exact.
+/// Positive weights below unit/2 become 0. Distances are summed as 32 bit integers in units.
+///
+/// Only Dijkstra is offered: rounding down can make quantized paths shorter than the straight-line distance,
+/// which would break the admissibility of the Euclidean heuristic.
+template <typename TWeight>
+class CompactGraph {
+public:
+    static constexpr uint32_t max_weight = [] {
+        if constexpr (std::is_same_v<TWeight, uint24>)
+            return uint24::max();
+        else
+            return static_cast<uint32_t>(std::numeric_limits<TWeight>::max());
+    }();
+    static constexpr uint32_t no_node = std::numeric_limits<uint32_t>::max();
+
+    CompactGraph() = default;
+    /// builds the graph from edge lists in compressed sparse rows (the edges of node u are at [offsets[u], offsets[u+1]));
+    /// unit = 0 picks the finest unit that can still represent the largest weight and for which no simple path
+    /// can overflow the 32 bit distances
+    CompactGraph(const std::vector<uint64_t>& offsets, const std::vector<uint32_t>& targets, const std::vector<float>& weights, float unit = 0.0f);
+    /// compacts a ShortestPaths graph, keeping its node order and original ids
+    static CompactGraph from(const ShortestPaths& graph, float unit = 0.0f);
+    /// Builds the graph from text files, e.g. exported road networks with hundreds of millions of lines.
+    ///   nodes_file: one node per line, "id x y" (node i of the graph is the one with the i-th smallest id)
+    ///   edges_file: one edge per line, "from to weight" with the ids of the nodes file
+    /// Fields are separated by whitespace or commas. Lines that start with '#', '%' or a word (headers, DIMACS "c"
+    /// and "p" lines) are skipped, except for a leading "v" or "a" tag, so DIMACS .co and .gr files can be read directly.
+    /// Files are read in blocks whose lines are parsed in parallel. The edges file is read twice: the first pass counts
+    /// the out-degrees and finds the weight unit, the second one writes every edge quantized into its final row; then
+    /// the rows are sorted and duplicate edges keep their minimum weight. Apart from the final graph, this needs the
+    /// node ids and one block of text, so the peak memory stays below about 1.5 times the final graph.
+    /// If file_ids is given, it receives the sorted node ids of the nodes file.
+    static CompactGraph load_edge_list(const std::string& nodes_file, const std::string& edges_file, const EdgeListOptions& options = {}, std::vector<uint64_t>* file_ids = nullptr);
+    /// reads the edges, positions and ids of a routing snapshot without going through the dense ShortestPaths
+    /// matrix, e.g. for generated graphs with millions of nodes (see graph_generator.h); names and index are skipped
+    static CompactGraph load_snapshot(const std::string& filename, float unit = 0.0f);
+
+    size_t size() const { return edge_offsets.empty() ? 0 : edge_offsets.size()-1; }
+    size_t num_edges() const { return edge_targets.size(); }
+    /// length of one weight step
+    float unit() const { return weight_unit; }
+    size_t memory_bytes() const;
+
+    /// shortest path between two original ids, in original ids (empty if not reachable)
+    std::vector<uint32_t> compute_shortest_path(uint32_t from, uint32_t to) const;
+    /// length of the shortest path in the units of the input weights (infinity if not reachable)
+    float distance(uint32_t from, uint32_t to) const;
+
+    uint32_t to_internal(uint32_t original_id) const { return internal_ids.empty() ? original_id : internal_ids.at(original_id); }
+    uint32_t to_external(uint32_t internal_id) const { return external_ids.empty() ? internal_id : external_ids.at(internal_id); }
+    /// assigns original ids to the stored nodes (external_ids[internal id] = original id)
+    void set_external_ids(std::vector<uint32_t> ids);
+
+    /// node positions (internal order), optional
+    std::vector<float> pos_x, pos_y;
+
+private:
+    /// the given unit, or the automatic one if it is 0 (see the constructor); throws if max_input does not fit
+    static float choose_unit(float unit, float max_input, size_t num_nodes);
+    TWeight quantize(float weight) const {
+        return static_cast<TWeight>(std::min(static_cast<uint32_t>(std::lround(weight/weight_unit)), max_weight));
+    }
+
+    /// per-thread scratch memory of the search: 4+4 bytes per node plus one bit, queue entries have 8 bytes
+    struct Workspace {
+        std::vector<uint32_t> dists;
+        std::vector<uint32_t> predecessors;
+        std::vector<bool> visited;
+        /// (distance << 32 | node), ordered by distance first
+        std::vector<uint64_t> queue;
+    };
+    /// Dijkstra between internal ids, leaves the result in ws
+    void search(Workspace& ws, uint32_t from, uint32_t to) const;
+
+    float weight_unit = 1.0f;
+    std::vector<uint32_t> edge_offsets;
+    std::vector<uint32_t> edge_targets;
+    std::vector<TWeight> edge_weights;
+    /// empty if internal and original ids are the same
+    std::vector<uint32_t> external_ids;
+    std::vector<uint32_t> internal_ids;
+};
+
+extern template class CompactGraph<uint16_t>;
+extern template class CompactGraph<uint24>;
@@ -0,0 +1,250 @@
+#include "distance_oracle.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+namespace {
+    using QueueEntry = std::pair<float, uint32_t>;
+    constexpr auto queue_order = std::greater<QueueEntry>{};
+}
+
+DistanceOracle::DistanceOracle(const ShortestPaths& graph, unsigned levels, uint64_t seed)
+    : k(levels), num_nodes(graph.size())
+{
+    if (k == 0)
+        throw std::invalid_argument("the oracle needs at least one level");
+    if (num_nodes >= std::numeric_limits<uint32_t>::max())
+        throw std::length_error("too many nodes for the distance oracle");
+    const auto start = std::chrono::steady_clock::now();
+
+    // 1. undirected adjacency in original ids
+    edge_offsets.assign(num_nodes+1, 0);
+    for (size_t u=0; u<num_nodes; ++u) {
+        for (size_t v=0; v<num_nodes; ++v) {
+            const auto& forward = graph[u][v];
+            const auto& backward = graph[v][u];
+            if (u == v || (!forward && !backward))
+                continue;
+            edge_targets.push_back(static_cast<uint32_t>(v));
+            edge_weights.push_back(std::min(forward.value_or(INFINITY), backward.value_or(INFINITY)));
+        }
+        edge_offsets[u+1] = static_cast<uint32_t>(edge_targets.size());
+    }
+
+    // 2. sample the levels A_0 = V ⊇ A_1 ⊇ ... ⊇ A_{k-1}; level[v] is the highest level containing v
+    std::vector<unsigned> level(num_nodes, 0);
+    std::mt19937_64 prng(seed);
+    std::bernoulli_distribution keep(std::pow(static_cast<double>(std::max<size_t>(num_nodes, 2)), -1.0/static_cast<double>(k)));
+    for (size_t v=0; v<num_nodes; ++v)
+        while (level[v]+1 < k && keep(prng))
+            ++level[v];
+    // every connected component needs a node on the top level, otherwise queries inside it cannot terminate
+    {
+        std::vector<bool> reached(num_nodes, false);
+        std::vector<uint32_t> stack;
+        for (size_t root=0; root<num_nodes; ++root) {
+            if (reached[root])
+                continue;
+            bool has_top = false;
+            reached[root] = true;
+            stack.push_back(static_cast<uint32_t>(root));
+            while (!stack.empty()) {
+                const uint32_t u = stack.back();
+                stack.pop_back();
+                has_top = has_top || level[u]+1 == k;
+                for (uint32_t e=edge_offsets[u]; e<edge_offsets[u+1]; ++e)
+                    if (!reached[edge_targets[e]]) {
+                        reached[edge_targets[e]] = true;
+                        stack.push_back(edge_targets[e]);
+                    }
+            }
+            if (!has_top)
+                level[root] = k-1;
+        }
+    }
+
+    // 3. pivots: closest node of every level, and the distance towards it
+    pivots.resize(k*num_nodes);
+    pivot_dists.resize(k*num_nodes);
+    {
+        std::vector<uint32_t> sources;
+        std::vector<float> dists;
+        std::vector<uint32_t> closest;
+        for (unsigned i=0; i<k; ++i) {
+            sources.clear();
+            for (size_t v=0; v<num_nodes; ++v)
+                if (level[v] >= i)
+                    sources.push_back(static_cast<uint32_t>(v));
+            nearest_sources(sources, dists, closest);
+            std::copy(dists.begin(), dists.end(), pivot_dists.begin()+static_cast<std::ptrdiff_t>(i*num_nodes));
+            std::copy(closest.begin(), closest.end(), pivots.begin()+static_cast<std::ptrdiff_t>(i*num_nodes));
+        }
+    }
+
+    // 4. clusters: w of level i (exactly) is in the bunch of v iff d(w, v) < d(A_{i+1}, v)
+    std::vector<std::tuple<uint32_t, uint32_t, float>> entries; // (v, w, d(w, v))
+    {
+        std::vector<float> dists(num_nodes, INFINITY);
+        std::vector<uint32_t> touched;
+        std::vector<QueueEntry> queue;
+        for (size_t w=0; w<num_nodes; ++w) {
+            const unsigned i = level[w];
+            const auto next_level_dist = [&](uint32_t v) {
+                return i+1 < k ? pivot_dists[(i+1)*num_nodes+v] : INFINITY;
+            };
+
+            dists[w] = 0.0f;
+            touched.push_back(static_cast<uint32_t>(w));
+            queue.emplace_back(0.0f, static_cast<uint32_t>(w));
+            while (!queue.empty()) {
+                std::pop_heap(queue.begin(), queue.end(), queue_order);
+                const auto [dist, u] = queue.back();
+                queue.pop_back();
+                if (dist > dists[u])
+                    continue;
+                entries.emplace_back(u, static_cast<uint32_t>(w), dist);
+                for (uint32_t e=edge_offsets[u]; e<edge_offsets[u+1]; ++e) {
+                    const uint32_t v = edge_targets[e];
+                    const float new_dist = dist+edge_weights[e];
+                    // the cluster only grows into nodes that are closer to w than to the next level
+                    if (new_dist < dists[v] && new_dist < next_level_dist(v)) {
+                        if (dists[v] == INFINITY)
+                            touched.push_back(v);
+                        dists[v] = new_dist;
+                        queue.emplace_back(new_dist, v);
+                        std::push_heap(queue.begin(), queue.end(), queue_order);
+                    }
+                }
+            }
+            for (uint32_t v : touched)
+                dists[v] = INFINITY;
+            touched.clear();
+        }
+    }
+
+    // 5. bunches as compressed sparse rows sorted by member
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return std::tie(std::get<0>(a), std::get<1>(a)) < std::tie(std::get<0>(b), std::get<1>(b)); });
+    bunch_offsets.assign(num_nodes+1, 0);
+    bunch_members.reserve(entries.size());
+    bunch_dists.reserve(entries.size());
+    for (const auto& [v, w, dist] : entries) {
+        ++bunch_offsets[v+1];
+        bunch_members.push_back(w);
+        bunch_dists.push_back(dist);
+    }
+    for (size_t v=0; v<num_nodes; ++v)
+        bunch_offsets[v+1] += bunch_offsets[v];
+
+    stats.build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    stats.bunch_entries = bunch_members.size();
+    stats.memory_bytes = sizeof(uint32_t)*(pivots.size()+bunch_members.size())
+                       + sizeof(float)*(pivot_dists.size()+bunch_dists.size())
+                       + sizeof(size_t)*bunch_offsets.size();
+}
+
+void DistanceOracle::nearest_sources(const std::vector<uint32_t>& sources, std::vector<float>& dists, std::vector<uint32_t>& closest) const
+{
+    dists.assign(num_nodes, INFINITY);
+    closest.assign(num_nodes, std::numeric_limits<uint32_t>::max());
+    std::vector<QueueEntry> queue;
+    for (uint32_t s : sources) {
+        dists[s] = 0.0f;
+        closest[s] = s;
+        queue.emplace_back(0.0f, s);
+    }
+    std::make_heap(queue.begin(), queue.end(), queue_order);
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), queue_order);
+        const auto [dist, u] = queue.back();
+        queue.pop_back();
+        if (dist > dists[u])
+            continue;
+        for (uint32_t e=edge_offsets[u]; e<edge_offsets[u+1]; ++e) {
+            const uint32_t v = edge_targets[e];
+            const float new_dist = dist+edge_weights[e];
+            if (new_dist < dists[v]) {
+                dists[v] = new_dist;
+                closest[v] = closest[u];
+                queue.emplace_back(new_dist, v);
+                std::push_heap(queue.begin(), queue.end(), queue_order);
+            }
+        }
+    }
+}
+
+const float* DistanceOracle::bunch_distance(size_t node, uint32_t member) const
+{
+    const auto begin = bunch_members.begin()+static_cast<std::ptrdiff_t>(bunch_offsets[node]);
+    const auto end = bunch_members.begin()+static_cast<std::ptrdiff_t>(bunch_offsets[node+1]);
+    const auto it = std::lower_bound(begin, end, member);
+    if (it == end || *it != member)
+        return nullptr;
+    return &bunch_dists[static_cast<size_t>(it-bunch_members.begin())];
+}
+
+float DistanceOracle::distance(size_t from, size_t to) const
+{
+    if (from >= num_nodes || to >= num_nodes)
+        throw std::out_of_range("node id out of range");
+
+    size_t u = from, v = to;
+    uint32_t w = static_cast<uint32_t>(u);
+    float dist_wu = 0.0f;
+    for (unsigned i=0; ; ) {
+        if (const float* dist_wv = bunch_distance(v, w))
+            return dist_wu+*dist_wv;
+        if (++i == k)
+            return INFINITY; // not connected: even the top level pivot is not in the bunch
+        std::swap(u, v);
+        w = pivots[i*num_nodes+u];
+        dist_wu = pivot_dists[i*num_nodes+u];
+        if (dist_wu == INFINITY)
+            return INFINITY;
+    }
+}
+
+DistanceOracle::StretchStats DistanceOracle::measure_stretch(size_t num_samples, uint64_t seed) const
+{
+    StretchStats result;
+    if (num_nodes == 0)
+        return result;
+
+    std::mt19937_64 prng(seed);
+    std::uniform_int_distribution<size_t> node(0, num_nodes-1);
+    std::vector<double> stretches;
+    stretches.reserve(num_samples);
+    std::vector<float> exact;
+    std::vector<uint32_t> unused;
+    // the exact distances of one source serve several targets
+    constexpr size_t targets_per_source = 16;
+    for (size_t sample=0; sample<num_samples; ) {
+        const auto source = static_cast<uint32_t>(node(prng));
+        nearest_sources({source}, exact, unused);
+        for (size_t t=0; t<targets_per_source && sample<num_samples; ++t, ++sample) {
+            const size_t target = node(prng);
+            if (target == source || exact[target] == INFINITY)
+                continue;
+            stretches.push_back(static_cast<double>(distance(source, target))/static_cast<double>(exact[target]));
+        }
+    }
+    if (stretches.empty())
+        return result;
+
+    std::sort(stretches.begin(), stretches.end());
+    const auto percentile = [&](double p) { return stretches[static_cast<size_t>(p*static_cast<double>(stretches.size()-1))]; };
+    result.num_samples = stretches.size();
+    for (double s : stretches)
+        result.mean += s;
+    result.mean /= static_cast<double>(stretches.size());
+    result.p50 = percentile(0.5);
+    result.p90 = percentile(0.9);
+    result.p99 = percentile(0.99);
+    result.max = stretches.back();
+    return result;
+}
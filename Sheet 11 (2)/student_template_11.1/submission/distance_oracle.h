@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "shortest_paths.h"
+
+/// Thorup-Zwick approximate distance oracle.
+/// With k levels, distance() returns a value between the exact distance and (2k-1) times the exact distance
+/// (k=2: stretch 3, k=3: stretch 5) using expected O(k*n^(1+1/k)) space and O(k) time per query.
+/// The graph is treated as undirected: an edge in either direction connects two nodes, if both directions
+/// exist the shorter one is used. All node ids are the original ids of the ShortestPaths graph.
+class DistanceOracle {
+public:
+    /// sizes and timings of the preprocessing
+    struct BuildStats {
+        double build_seconds = 0.0;
+        /// total number of (node, bunch member) pairs
+        size_t bunch_entries = 0;
+        size_t memory_bytes = 0;
+    };
+
+    /// measured ratio of approximate and exact distance over sampled reachable node pairs
+    struct StretchStats {
+        size_t num_samples = 0;
+        double mean = 0.0;
+        double p50 = 0.0, p90 = 0.0, p99 = 0.0;
+        double max = 0.0;
+    };
+
+    DistanceOracle(const ShortestPaths& graph, unsigned k, uint64_t seed = 1);
+
+    /// approximate distance, infinity if the nodes are not connected
+    float distance(size_t from, size_t to) const;
+
+    unsigned levels() const { return k; }
+    const BuildStats& build_stats() const { return stats; }
+
+    /// compares num_samples random queries against exact Dijkstra distances on the same (undirected) graph
+    StretchStats measure_stretch(size_t num_samples, uint64_t seed = 1) const;
+
+private:
+    /// multi-source Dijkstra from all sources; returns the distance to and the id of the closest source for each node
+    void nearest_sources(const std::vector<uint32_t>& sources, std::vector<float>& dists, std::vector<uint32_t>& closest) const;
+    /// distance of member in the bunch of node, or no value if member is not in the bunch
+    const float* bunch_distance(size_t node, uint32_t member) const;
+
+    unsigned k;
+    size_t num_nodes;
+    /// undirected graph as compressed sparse rows
+    std::vector<uint32_t> edge_offsets;
+    std::vector<uint32_t> edge_targets;
+    std::vector<float> edge_weights;
+
+    /// pivot[i*num_nodes+v] = closest node of level i to v, pivot_dists the distance towards it
+    std::vector<uint32_t> pivots;
+    std::vector<float> pivot_dists;
+
+    /// bunch of node v: members sorted by id at [bunch_offsets[v], bunch_offsets[v+1])
+    std::vector<size_t> bunch_offsets;
+    std::vector<uint32_t> bunch_members;
+    std::vector<float> bunch_dists;
+
+    BuildStats stats;
+};
@@ -0,0 +1,325 @@
+#include "compact_graph.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    struct NodeRecord {
+        uint64_t id;
+        float x, y;
+    };
+
+    bool is_separator(char c) { return c == ' ' || c == '\t' || c == ',' || c == '\r'; }
+
+    /// numeric fields of one line
+    class Fields {
+    public:
+        Fields(const char* b, const char* e) : begin(b), pos(b), end(e) {}
+
+        template <typename T>
+        T next()
+        {
+            while (pos < end && is_separator(*pos))
+                ++pos;
+            T value {};
+            const auto [last, error] = std::from_chars(pos, end, value);
+            if (error != std::errc{} || (last < end && !is_separator(*last)))
+                throw std::runtime_error("malformed line: "+std::string(begin, end));
+            pos = last;
+            return value;
+        }
+
+    private:
+        const char* begin;
+        const char* pos;
+        const char* end;
+    };
+
+    /// calls parse(fields) for every data line in [begin, end)
+    template <typename Parse>
+    void for_each_line(const char* begin, const char* end, Parse&& parse)
+    {
+        while (begin < end) {
+            const char* line_end = std::find(begin, end, '\n');
+            const char* p = begin;
+            while (p < line_end && is_separator(*p))
+                ++p;
+            // lines starting with '#', '%' or a word are comments or headers, "v" and "a" tag DIMACS nodes and arcs
+            if (p < line_end && (*p == '#' || *p == '%'))
+                p = line_end;
+            else if (p < line_end && std::isalpha(static_cast<unsigned char>(*p))) {
+                const bool tag = (*p == 'v' || *p == 'a') && p+1 < line_end && is_separator(p[1]);
+                p = tag ? p+1 : line_end;
+            }
+            if (std::find_if_not(p, line_end, is_separator) != line_end)
+                parse(Fields(p, line_end));
+            begin = line_end+1;
+        }
+    }
+
+    /// Reads filename in blocks of block_size bytes and splits each block at line ends into num_threads chunks.
+    /// parse(thread, begin, end) runs concurrently for the chunks of a block, consume(thread) afterwards in chunk
+    /// order on the calling thread.
+    template <typename Parse, typename Consume>
+    void parse_file(const std::string& filename, size_t block_size, size_t num_threads, Parse&& parse, Consume&& consume)
+    {
+        std::ifstream file(filename, std::ifstream::in|std::ifstream::binary);
+        if (!file)
+            throw std::runtime_error("cannot open "+filename);
+
+        std::vector<char> block(block_size);
+        size_t carried = 0; // incomplete last line of the previous block
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(num_threads);
+        while (true) {
+            file.read(block.data()+carried, static_cast<std::streamsize>(block_size-carried));
+            const size_t size = carried+static_cast<size_t>(file.gcount());
+            if (size == 0)
+                break;
+            const bool last_block = !file;
+            size_t complete = size;
+            if (!last_block) {
+                const auto line_end = std::find(block.rbegin()+static_cast<std::ptrdiff_t>(block_size-size), block.rend(), '\n');
+                if (line_end == block.rend())
+                    throw std::runtime_error("line longer than the block size in "+filename);
+                complete = static_cast<size_t>(block.rend()-line_end);
+            }
+
+            const char* const data = block.data();
+            size_t begin = 0;
+            for (size_t t=0; t<num_threads; ++t) {
+                size_t end = t+1 == num_threads ? complete : std::max(begin, complete*(t+1)/num_threads);
+                while (end > begin && end < complete && data[end-1] != '\n')
+                    ++end;
+                threads.emplace_back([&, t, begin, end] {
+                    try {
+                        parse(t, data+begin, data+end);
+                    }
+                    catch (...) {
+                        errors[t] = std::current_exception();
+                    }
+                });
+                begin = end;
+            }
+            for (std::thread& thread : threads)
+                thread.join();
+            threads.clear();
+            for (const std::exception_ptr& error : errors)
+                if (error)
+                    std::rethrow_exception(error);
+            for (size_t t=0; t<num_threads; ++t)
+                consume(t);
+
+            if (last_block)
+                break;
+            carried = size-complete;
+            std::copy(block.begin()+static_cast<std::ptrdiff_t>(complete), block.begin()+static_cast<std::ptrdiff_t>(size), block.begin());
+        }
+    }
+
+    /// maps the ids of the nodes file to dense node ids
+    class IdMap {
+    public:
+        explicit IdMap(std::vector<uint64_t> sorted_ids) : ids(std::move(sorted_ids))
+        {
+            contiguous = ids.empty() || ids.back()-ids.front() == ids.size()-1;
+        }
+
+        std::optional<uint32_t> find(uint64_t id) const
+        {
+            if (contiguous) {
+                if (ids.empty() || id < ids.front() || id-ids.front() >= ids.size())
+                    return std::nullopt;
+                return static_cast<uint32_t>(id-ids.front());
+            }
+            const auto it = std::lower_bound(ids.begin(), ids.end(), id);
+            if (it == ids.end() || *it != id)
+                return std::nullopt;
+            return static_cast<uint32_t>(it-ids.begin());
+        }
+
+        std::vector<uint64_t> release() { return std::move(ids); }
+
+    private:
+        std::vector<uint64_t> ids;
+        bool contiguous = true;
+    };
+}
+
+template <typename TWeight>
+CompactGraph<TWeight> CompactGraph<TWeight>::load_edge_list(const std::string& nodes_file, const std::string& edges_file, const EdgeListOptions& options, std::vector<uint64_t>* file_ids)
+{
+    TRACE_SCOPE("load_edge_list");
+    const size_t num_threads = options.num_threads > 0 ? options.num_threads : std::max(1u, std::thread::hardware_concurrency());
+    CompactGraph graph;
+
+    // 1. nodes, sorted by their id
+    std::optional<IdMap> ids;
+    {
+        std::vector<NodeRecord> nodes;
+        std::vector<std::vector<NodeRecord>> parsed(num_threads);
+        parse_file(nodes_file, options.block_size, num_threads, [&](size_t t, const char* begin, const char* end) {
+            for_each_line(begin, end, [&](Fields fields) {
+                const auto id = fields.next<uint64_t>();
+                const auto x = fields.next<float>();
+                parsed[t].push_back({id, x, fields.next<float>()});
+            });
+        }, [&](size_t t) {
+            // the first block tells how many nodes to expect, growing the vector by doubling would waste up to half;
+            // before its first chunk is consumed, all chunks of the block are still in parsed
+            if (nodes.capacity() == 0 && t == 0) {
+                size_t in_block = 0;
+                for (const auto& records : parsed)
+                    in_block += records.size();
+                const auto file_size = static_cast<double>(std::filesystem::file_size(nodes_file));
+                nodes.reserve(static_cast<size_t>(1.05*static_cast<double>(in_block)*file_size/std::min(file_size, static_cast<double>(options.block_size)))+16);
+            }
+            nodes.insert(nodes.end(), parsed[t].begin(), parsed[t].end());
+            parsed[t].clear();
+        });
+        parsed.clear();
+        if (nodes.size() >= no_node)
+            throw std::length_error("graph too large for 32 bit ids");
+
+        std::sort(nodes.begin(), nodes.end(), [](const NodeRecord& a, const NodeRecord& b) { return a.id < b.id; });
+        std::vector<uint64_t> sorted_ids;
+        sorted_ids.reserve(nodes.size());
+        graph.pos_x.reserve(nodes.size());
+        graph.pos_y.reserve(nodes.size());
+        for (const NodeRecord& node : nodes) {
+            if (!sorted_ids.empty() && sorted_ids.back() == node.id)
+                throw std::runtime_error("duplicate node id "+std::to_string(node.id)+" in "+nodes_file);
+            sorted_ids.push_back(node.id);
+            graph.pos_x.push_back(node.x);
+            graph.pos_y.push_back(node.y);
+        }
+        ids.emplace(std::move(sorted_ids));
+    }
+    const size_t num_nodes = graph.pos_x.size();
+
+    // calls add(u, v, weight) for every edge in [begin, end), in dense node ids
+    const auto for_each_edge = [&](const char* begin, const char* end, auto&& add) {
+        for_each_line(begin, end, [&](Fields fields) {
+            const auto from = fields.next<uint64_t>();
+            const auto to = fields.next<uint64_t>();
+            const auto weight = fields.next<float>();
+            const auto u = ids->find(from);
+            const auto v = ids->find(to);
+            if (!u || !v)
+                throw std::runtime_error("edge "+std::to_string(from)+" -> "+std::to_string(to)+" refers to an unknown node");
+            if (!(weight >= 0.0f && std::isfinite(weight)))
+                throw std::invalid_argument("edge weights have to be finite and non-negative");
+            add(*u, *v, weight);
+            if (options.bidirectional)
+                add(*v, *u, weight);
+        });
+    };
+
+    // 2. first pass over the edges: out-degrees and the largest weight, which fixes the unit
+    std::vector<float> max_inputs(num_threads, 0.0f);
+    std::vector<size_t> counts(num_threads, 0);
+    graph.edge_offsets.assign(num_nodes+1, 0);
+    parse_file(edges_file, options.block_size, num_threads, [&](size_t t, const char* begin, const char* end) {
+        for_each_edge(begin, end, [&](uint32_t u, uint32_t, float weight) {
+            std::atomic_ref<uint32_t>(graph.edge_offsets[u+1]).fetch_add(1, std::memory_order_relaxed);
+            max_inputs[t] = std::max(max_inputs[t], weight);
+            ++counts[t];
+        });
+    }, [](size_t) {});
+    size_t num_parsed = 0;
+    for (const size_t count : counts)
+        num_parsed += count;
+    if (num_parsed > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("graph too large for 32 bit ids");
+    graph.weight_unit = choose_unit(options.unit, *std::max_element(max_inputs.begin(), max_inputs.end()), num_nodes);
+    for (size_t u=0; u<num_nodes; ++u)
+        graph.edge_offsets[u+1] += graph.edge_offsets[u];
+
+    // 3. second pass: every edge is written to the next free slot of its row, edge_offsets[u] serves as the cursor
+    // of row u and ends up at the start of row u+1
+    graph.edge_targets.resize(num_parsed);
+    graph.edge_weights.resize(num_parsed);
+    std::fill(counts.begin(), counts.end(), 0);
+    parse_file(edges_file, options.block_size, num_threads, [&](size_t t, const char* begin, const char* end) {
+        for_each_edge(begin, end, [&](uint32_t u, uint32_t v, float weight) {
+            const uint32_t e = std::atomic_ref<uint32_t>(graph.edge_offsets[u]).fetch_add(1, std::memory_order_relaxed);
+            if (e >= num_parsed)
+                throw std::runtime_error(edges_file+" changed while it was read");
+            graph.edge_targets[e] = v;
+            graph.edge_weights[e] = graph.quantize(weight);
+            ++counts[t];
+        });
+    }, [](size_t) {});
+    if (std::accumulate(counts.begin(), counts.end(), size_t{0}) != num_parsed)
+        throw std::runtime_error(edges_file+" changed while it was read");
+    if (file_ids)
+        *file_ids = ids->release();
+    ids.reset();
+    std::copy_backward(graph.edge_offsets.begin(), graph.edge_offsets.end()-1, graph.edge_offsets.end());
+    graph.edge_offsets[0] = 0;
+
+    // 4. rows sorted by target, duplicate edges keep their minimum weight; each thread compacts the rows of a node
+    // range towards the start of the range, the ranges are then moved together
+    std::vector<uint32_t> range_ends(num_threads);
+    std::vector<std::thread> threads;
+    for (size_t t=0; t<num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            const size_t first = num_nodes*t/num_threads;
+            const size_t last = num_nodes*(t+1)/num_threads;
+            std::vector<std::pair<uint32_t, uint32_t>> row;
+            uint32_t out = graph.edge_offsets[first];
+            for (size_t u=first; u<last; ++u) {
+                row.clear();
+                for (uint32_t e=graph.edge_offsets[u]; e<graph.edge_offsets[u+1]; ++e)
+                    row.emplace_back(graph.edge_targets[e], static_cast<uint32_t>(graph.edge_weights[e]));
+                std::sort(row.begin(), row.end());
+                row.erase(std::unique(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first == b.first; }), row.end());
+                // edge_offsets[first] belongs to the previous range as well and stays unchanged
+                if (u != first)
+                    graph.edge_offsets[u] = out;
+                for (const auto& [v, weight] : row) {
+                    graph.edge_targets[out] = v;
+                    graph.edge_weights[out] = static_cast<TWeight>(weight);
+                    ++out;
+                }
+            }
+            range_ends[t] = out;
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    uint32_t num_edges = 0;
+    for (size_t t=0; t<num_threads; ++t) {
+        const size_t first = num_nodes*t/num_threads;
+        const size_t last = num_nodes*(t+1)/num_threads;
+        const uint32_t begin = graph.edge_offsets[first];
+        std::copy(graph.edge_targets.begin()+begin, graph.edge_targets.begin()+range_ends[t], graph.edge_targets.begin()+num_edges);
+        std::copy(graph.edge_weights.begin()+begin, graph.edge_weights.begin()+range_ends[t], graph.edge_weights.begin()+num_edges);
+        for (size_t u=first; u<last; ++u)
+            graph.edge_offsets[u] -= begin-num_edges;
+        num_edges += range_ends[t]-begin;
+    }
+    graph.edge_offsets[num_nodes] = num_edges;
+    graph.edge_targets.resize(num_edges);
+    graph.edge_weights.resize(num_edges);
+    return graph;
+}
+
+template CompactGraph<uint16_t> CompactGraph<uint16_t>::load_edge_list(const std::string&, const std::string&, const EdgeListOptions&, std::vector<uint64_t>*);
+template CompactGraph<uint24> CompactGraph<uint24>::load_edge_list(const std::string&, const std::string&, const EdgeListOptions&, std::vector<uint64_t>*);
@@ -0,0 +1,374 @@
+#include "graph_generator.h"
+#include "binary_io.h"
+#include "routing_snapshot.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    using graph_generator::Options;
+
+    /// splitmix64 finalizer
+    uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15;
+        x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27))*0x94d049bb133111eb;
+        return x ^ (x >> 31);
+    }
+
+    /// uniform in [0, 1) and a pure function of its arguments, so every pass sees the same random values
+    float hash01(uint64_t seed, uint64_t salt, uint64_t a, uint64_t b = 0)
+    {
+        return static_cast<float>(mix(mix(mix(seed ^ salt) ^ a) ^ b) >> 40)*0x1p-24f;
+    }
+
+    enum Salt : uint64_t { jitter_x = 1, jitter_y, drop_edge, detour_edge };
+
+    /// streams an array in the layout of binary_io::write_array without holding it in memory
+    template <typename T>
+    class ArrayWriter {
+    public:
+        ArrayWriter(std::ostream& s, uint64_t size) : stream(s), remaining(size)
+        {
+            binary_io::write_value(stream, size);
+            buffer.reserve(chunk_size);
+        }
+
+        void push(T value)
+        {
+            if (remaining-- == 0)
+                throw std::logic_error("array is longer than announced");
+            buffer.push_back(value);
+            if (buffer.size() == chunk_size)
+                flush();
+        }
+
+        void finish()
+        {
+            flush();
+            if (remaining != 0)
+                throw std::logic_error("array is shorter than announced");
+        }
+
+    private:
+        void flush()
+        {
+            stream.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(sizeof(T)*buffer.size()));
+            buffer.clear();
+        }
+
+        static constexpr size_t chunk_size = 1 << 16;
+        std::ostream& stream;
+        uint64_t remaining;
+        std::vector<T> buffer;
+    };
+
+    /// jittered square lattice, row by row; all node positions and edges are computed from the node id
+    class Lattice {
+    public:
+        enum class Diagonals { None, All, Shorter };
+
+        Lattice(const Options& options, Diagonals d)
+            : num_nodes(options.num_nodes), spacing(options.spacing), jitter(options.jitter), seed(options.seed), diagonals(d),
+              width(std::max<size_t>(1, static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(options.num_nodes)))))) {}
+
+        size_t size() const { return num_nodes; }
+        size_t memory_bytes() const { return 0; }
+        float x(size_t u) const { return (static_cast<float>(u%width)+jitter*(2.0f*hash01(seed, jitter_x, u)-1.0f))*spacing; }
+        float y(size_t u) const { return (static_cast<float>(u/width)+jitter*(2.0f*hash01(seed, jitter_y, u)-1.0f))*spacing; }
+
+        /// calls visit(v, distance) for all neighbors v of u in ascending order
+        template <typename Visitor>
+        void neighbors(size_t u, Visitor&& visit) const
+        {
+            const auto r = static_cast<std::ptrdiff_t>(u/width);
+            const auto c = static_cast<std::ptrdiff_t>(u%width);
+            for (std::ptrdiff_t dr=-1; dr<=1; ++dr) {
+                for (std::ptrdiff_t dc=-1; dc<=1; ++dc) {
+                    if ((dr == 0 && dc == 0) || !exists(r+dr, c+dc))
+                        continue;
+                    if (dr != 0 && dc != 0) {
+                        if (diagonals == Diagonals::None)
+                            continue;
+                        // the diagonal lies in the cell whose top left corner is (min(r, r+dr), min(c, c+dc))
+                        if (diagonals == Diagonals::Shorter && shorter_diagonal(std::min(r, r+dr), std::min(c, c+dc)) != (dr == dc))
+                            continue;
+                    }
+                    const size_t v = id(r+dr, c+dc);
+                    visit(v, distance(u, v));
+                }
+            }
+        }
+
+    private:
+        bool exists(std::ptrdiff_t r, std::ptrdiff_t c) const
+        {
+            return r >= 0 && c >= 0 && static_cast<size_t>(c) < width && id(r, c) < num_nodes;
+        }
+        size_t id(std::ptrdiff_t r, std::ptrdiff_t c) const { return static_cast<size_t>(r)*width+static_cast<size_t>(c); }
+        float distance(size_t u, size_t v) const { return std::hypot(x(u)-x(v), y(u)-y(v)); }
+
+        /// whether the cell with top left corner (r, c) is split along its main diagonal (r, c)-(r+1, c+1)
+        /// rather than (r, c+1)-(r+1, c); partial cells at the border are not split at all
+        std::optional<bool> shorter_diagonal(std::ptrdiff_t r, std::ptrdiff_t c) const
+        {
+            if (!exists(r+1, c+1) || !exists(r, c+1) || !exists(r+1, c))
+                return std::nullopt;
+            return distance(id(r, c), id(r+1, c+1)) <= distance(id(r, c+1), id(r+1, c));
+        }
+
+        size_t num_nodes;
+        float spacing, jitter;
+        uint64_t seed;
+        Diagonals diagonals;
+        size_t width;
+    };
+
+    /// uniformly distributed nodes in a square, numbered cell by cell of a uniform grid; u and v are neighbors if one
+    /// of them is among the k nearest nodes of the other. Keeps the positions and the k-th nearest neighbor of
+    /// every node, so that membership in the neighborhood of another node can be decided without storing it.
+    class NearestNeighbors {
+    public:
+        static constexpr size_t max_degree = 64;
+
+        explicit NearestNeighbors(const Options& options)
+        {
+            const size_t num_nodes = options.num_nodes;
+            const size_t k = std::min(options.degree, num_nodes-1);
+            const float side = options.spacing*std::sqrt(static_cast<float>(num_nodes));
+            cells = static_cast<uint32_t>(std::max(1.0, std::ceil(std::sqrt(static_cast<double>(num_nodes)/2.0))));
+            cell_size = side/static_cast<float>(cells);
+
+            // 1. count the nodes per cell, then draw the same positions again and place them cell by cell
+            const auto draw = [&](auto&& place) {
+                std::mt19937_64 prng(options.seed);
+                std::uniform_real_distribution<float> coordinate(0.0f, side);
+                for (size_t i=0; i<num_nodes; ++i) {
+                    const float x = coordinate(prng);
+                    const float y = coordinate(prng);
+                    place(x, y, cell_y(y)*cells+cell_x(x));
+                }
+            };
+            cell_offsets.assign(static_cast<size_t>(cells)*cells+1, 0);
+            draw([&](float, float, size_t cell) { ++cell_offsets[cell+1]; });
+            for (size_t c=1; c<cell_offsets.size(); ++c)
+                cell_offsets[c] += cell_offsets[c-1];
+            xs.resize(num_nodes);
+            ys.resize(num_nodes);
+            {
+                std::vector<uint32_t> fill(cell_offsets.begin(), cell_offsets.end()-1);
+                draw([&](float x, float y, size_t cell) {
+                    xs[fill[cell]] = x;
+                    ys[fill[cell]] = y;
+                    ++fill[cell];
+                });
+            }
+
+            // 2. the k-th nearest neighbor of every node, by a ring search around its cell
+            kth_dist2.assign(num_nodes, k == 0 ? -1.0f : INFINITY);
+            kth_id.assign(num_nodes, 0);
+            float max_dist2 = 0.0f;
+            std::array<std::pair<float, uint32_t>, max_degree> best;
+            for (uint32_t u=0; u<num_nodes && k>0; ++u) {
+                size_t count = 0;
+                const auto cx = static_cast<std::ptrdiff_t>(cell_x(xs[u]));
+                const auto cy = static_cast<std::ptrdiff_t>(cell_y(ys[u]));
+                for (std::ptrdiff_t ring=0; ; ++ring) {
+                    for_each_cell(cx, cy, ring, [&](std::ptrdiff_t x, std::ptrdiff_t y) {
+                        if (std::max(std::abs(x-cx), std::abs(y-cy)) != ring)
+                            return;
+                        for_each_node(x, y, [&](uint32_t v) {
+                            if (v == u)
+                                return;
+                            const std::pair<float, uint32_t> candidate {dist2(u, v), v};
+                            if (count == k && !(candidate < best[k-1]))
+                                return;
+                            size_t i = count < k ? count++ : k-1;
+                            for (; i>0 && candidate < best[i-1]; --i)
+                                best[i] = best[i-1];
+                            best[i] = candidate;
+                        });
+                    });
+                    // all nodes beyond the ring are at least ring*cell_size away
+                    const float bound = static_cast<float>(ring)*cell_size;
+                    if ((count == k && best[k-1].first < bound*bound) || ring >= static_cast<std::ptrdiff_t>(cells))
+                        break;
+                }
+                kth_dist2[u] = best[k-1].first;
+                kth_id[u] = best[k-1].second;
+                max_dist2 = std::max(max_dist2, kth_dist2[u]);
+            }
+            window = static_cast<std::ptrdiff_t>(std::ceil(std::sqrt(max_dist2)/cell_size));
+        }
+
+        size_t size() const { return xs.size(); }
+        size_t memory_bytes() const
+        {
+            return sizeof(float)*(xs.size()+ys.size()+kth_dist2.size())+sizeof(uint32_t)*(kth_id.size()+cell_offsets.size());
+        }
+        float x(size_t u) const { return xs[u]; }
+        float y(size_t u) const { return ys[u]; }
+
+        /// calls visit(v, distance) for all neighbors v of u in ascending order
+        template <typename Visitor>
+        void neighbors(size_t node, Visitor&& visit) const
+        {
+            const auto u = static_cast<uint32_t>(node);
+            // no neighborhood reaches further than the largest k-th nearest neighbor distance
+            for_each_cell(static_cast<std::ptrdiff_t>(cell_x(xs[u])), static_cast<std::ptrdiff_t>(cell_y(ys[u])), window, [&](std::ptrdiff_t x, std::ptrdiff_t y) {
+                for_each_node(x, y, [&](uint32_t v) {
+                    if (v == u)
+                        return;
+                    const float d2 = dist2(u, v);
+                    if (is_near(d2, v, u) || is_near(d2, u, v))
+                        visit(static_cast<size_t>(v), std::sqrt(d2));
+                });
+            });
+        }
+
+    private:
+        uint32_t cell_x(float x) const { return std::min(cells-1, static_cast<uint32_t>(x/cell_size)); }
+        uint32_t cell_y(float y) const { return std::min(cells-1, static_cast<uint32_t>(y/cell_size)); }
+
+        /// squared distance, always evaluated in the same operand order so that both ends get the same value
+        float dist2(uint32_t u, uint32_t v) const
+        {
+            if (u > v)
+                std::swap(u, v);
+            const float dx = xs[v]-xs[u];
+            const float dy = ys[v]-ys[u];
+            return dx*dx+dy*dy;
+        }
+
+        /// whether v (at squared distance d2) is among the k nearest nodes of u, ties are broken by id
+        bool is_near(float d2, uint32_t v, uint32_t u) const
+        {
+            return std::make_pair(d2, v) <= std::make_pair(kth_dist2[u], kth_id[u]);
+        }
+
+        /// cells within Chebyshev distance radius of (cx, cy), row by row
+        template <typename Visitor>
+        void for_each_cell(std::ptrdiff_t cx, std::ptrdiff_t cy, std::ptrdiff_t radius, Visitor&& visit) const
+        {
+            const auto last = static_cast<std::ptrdiff_t>(cells)-1;
+            for (std::ptrdiff_t y=std::max<std::ptrdiff_t>(0, cy-radius); y<=std::min(last, cy+radius); ++y)
+                for (std::ptrdiff_t x=std::max<std::ptrdiff_t>(0, cx-radius); x<=std::min(last, cx+radius); ++x)
+                    visit(x, y);
+        }
+
+        template <typename Visitor>
+        void for_each_node(std::ptrdiff_t x, std::ptrdiff_t y, Visitor&& visit) const
+        {
+            const size_t cell = static_cast<size_t>(y)*cells+static_cast<size_t>(x);
+            for (uint32_t v=cell_offsets[cell]; v<cell_offsets[cell+1]; ++v)
+                visit(v);
+        }
+
+        uint32_t cells = 1;
+        float cell_size = 1.0f;
+        std::ptrdiff_t window = 0;
+        /// nodes of cell c are [cell_offsets[c], cell_offsets[c+1])
+        std::vector<uint32_t> cell_offsets;
+        std::vector<float> xs, ys;
+        std::vector<float> kth_dist2;
+        std::vector<uint32_t> kth_id;
+    };
+
+    template <typename Graph>
+    graph_generator::Stats write_graph(std::ostream& file, const Graph& graph, const Options& options)
+    {
+        const size_t num_nodes = graph.size();
+        const auto edge_hash = [&](uint64_t salt, size_t u, size_t v) { return hash01(options.seed, salt, std::min(u, v), std::max(u, v)); };
+        const auto for_each_edge = [&](size_t u, auto&& visit) {
+            graph.neighbors(u, [&](size_t v, float distance) {
+                if (options.drop <= 0.0f || edge_hash(drop_edge, u, v) >= options.drop)
+                    visit(v, distance);
+            });
+        };
+
+        routing_snapshot::write_header(file, num_nodes);
+
+        // 1. nodes: no names, positions
+        {
+            const std::vector<char> empty_names(sizeof(uint32_t)*4096, '\0');
+            for (size_t written=0; written<num_nodes; written+=4096)
+                file.write(empty_names.data(), static_cast<std::streamsize>(sizeof(uint32_t)*std::min<size_t>(4096, num_nodes-written)));
+        }
+        ArrayWriter<float> xs(file, num_nodes);
+        for (size_t u=0; u<num_nodes; ++u)
+            xs.push(graph.x(u));
+        xs.finish();
+        ArrayWriter<float> ys(file, num_nodes);
+        for (size_t u=0; u<num_nodes; ++u)
+            ys.push(graph.y(u));
+        ys.finish();
+
+        // 2. edges: one pass over all nodes for each of the offsets, targets and weights
+        uint64_t num_edges = 0;
+        ArrayWriter<uint64_t> offsets(file, num_nodes+1);
+        offsets.push(0);
+        for (size_t u=0; u<num_nodes; ++u) {
+            for_each_edge(u, [&](size_t, float) { ++num_edges; });
+            offsets.push(num_edges);
+        }
+        offsets.finish();
+        ArrayWriter<uint32_t> targets(file, num_edges);
+        for (size_t u=0; u<num_nodes; ++u)
+            for_each_edge(u, [&](size_t v, float) { targets.push(static_cast<uint32_t>(v)); });
+        targets.finish();
+        ArrayWriter<float> weights(file, num_edges);
+        for (size_t u=0; u<num_nodes; ++u)
+            for_each_edge(u, [&](size_t v, float distance) { weights.push(distance*(1.0f+options.detour*edge_hash(detour_edge, u, v))); });
+        weights.finish();
+
+        // 3. no id map (the generated order is the original one), no spatial index
+        binary_io::write_value<uint64_t>(file, 0);
+        binary_io::write_value<uint8_t>(file, 0);
+
+        graph_generator::Stats stats;
+        stats.num_nodes = num_nodes;
+        stats.num_edges = num_edges;
+        stats.memory_bytes = graph.memory_bytes();
+        return stats;
+    }
+}
+
+graph_generator::Stats graph_generator::write_snapshot(const std::string& filename, const Options& options)
+{
+    if (options.num_nodes == 0 || options.num_nodes >= std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("the number of nodes has to be in [1, 2^32-1)");
+    if (!(options.spacing > 0.0f) || !(options.jitter >= 0.0f && options.jitter <= 0.25f) || !(options.drop >= 0.0f && options.drop < 1.0f) || !(options.detour >= 0.0f))
+        throw std::invalid_argument("invalid spacing, jitter, drop or detour");
+    if (options.layout == Layout::Knn && (options.degree == 0 || options.degree > NearestNeighbors::max_degree))
+        throw std::invalid_argument("kNN degree has to be in [1, 64]");
+    if (options.layout == Layout::Grid && options.degree != 4 && options.degree != 8)
+        throw std::invalid_argument("grid degree has to be 4 or 8");
+
+    std::ofstream file(filename, std::ofstream::out|std::ofstream::trunc|std::ofstream::binary);
+    if (!file)
+        throw std::runtime_error("cannot open "+filename);
+    const auto start = std::chrono::steady_clock::now();
+
+    Stats stats;
+    switch (options.layout) {
+        case Layout::Knn: stats = write_graph(file, NearestNeighbors(options), options); break;
+        case Layout::Grid: stats = write_graph(file, Lattice(options, options.degree == 8 ? Lattice::Diagonals::All : Lattice::Diagonals::None), options); break;
+        case Layout::Delaunay: stats = write_graph(file, Lattice(options, Lattice::Diagonals::Shorter), options); break;
+    }
+
+    file.flush();
+    if (!file)
+        throw std::runtime_error("writing "+filename+" failed");
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    return stats;
+}
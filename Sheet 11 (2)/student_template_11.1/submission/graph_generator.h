@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Synthetic road-like graphs of up to billions of edges, written directly into the routing snapshot format
+/// (see routing_snapshot.h). Edges are symmetric and weighted by the distance of their nodes times a random
+/// detour factor >= 1, so the Euclidean heuristic stays admissible. Nodes are numbered in a spatially local order.
+///
+/// Nothing is stored per edge: the edges of a node are recomputed in each of the three passes over the nodes
+/// (degrees for the offsets, targets, weights), and only the node positions of the kNN layout are kept in memory.
+namespace graph_generator {
+
+    enum class Layout {
+        /// uniformly distributed nodes connected to their degree nearest neighbors in both directions,
+        /// like connect_nearest (only nearly planar, the degrees vary)
+        Knn,
+        /// jittered square lattice with 4 (planar) or 8 neighbors
+        Grid,
+        /// jittered lattice with the shorter diagonal of every cell: a planar triangulation with an average
+        /// degree of about 6, which approximates the Delaunay triangulation of the nodes
+        Delaunay,
+    };
+
+    struct Options {
+        Layout layout = Layout::Knn;
+        size_t num_nodes = 1'000'000;
+        /// Knn: nearest neighbors per node (1..64), Grid: 4 or 8, ignored by Delaunay
+        size_t degree = 5;
+        /// average distance between neighboring nodes in kilometers
+        float spacing = 1.0f;
+        /// Grid and Delaunay move every node by up to jitter*spacing along each axis, in [0, 0.25]
+        float jitter = 0.2f;
+        /// fraction of edges that are left out, e.g. to thin a lattice to a lower degree, in [0, 1)
+        float drop = 0.0f;
+        /// edge weights are distance*(1+detour*u) with u uniform in [0, 1) per edge
+        float detour = 0.2f;
+        uint64_t seed = 42;
+    };
+
+    struct Stats {
+        size_t num_nodes = 0;
+        /// directed edges, i.e. twice the number of roads
+        size_t num_edges = 0;
+        /// memory kept during the passes over the edges, independent of the number of edges
+        size_t memory_bytes = 0;
+        double seconds = 0.0;
+    };
+
+    Stats write_snapshot(const std::string& filename, const Options& options);
+}
@@ -0,0 +1,104 @@
+#include "shortest_paths.h"
+#include "search_kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    /// per-thread memory of the multi-target searches
+    struct MultiTargetWorkspace {
+        ShortestPaths::SearchWorkspace search;
+        /// internal ids of the targets, and a flag for every node that is one of them
+        std::vector<size_t> targets;
+        std::vector<bool> is_target;
+        /// positions of the targets, for the heuristic
+        std::vector<std::pair<float, float>> positions;
+    };
+
+    /// maps the targets to internal ids and marks them in ws.is_target; returns the number of distinct targets
+    size_t prepare_targets(const ShortestPaths& graph, std::span<const size_t> targets, MultiTargetWorkspace& ws)
+    {
+        ws.targets.clear();
+        ws.positions.clear();
+        ws.is_target.assign(graph.size(), false);
+        size_t num_distinct = 0;
+        for (size_t target : targets) {
+            if (target >= graph.size())
+                throw std::out_of_range("node id out of range");
+            const size_t node = graph.to_internal(target);
+            ws.targets.push_back(node);
+            if (!ws.is_target[node]) {
+                ws.is_target[node] = true;
+                ws.positions.emplace_back(graph.internal_node(node).pos_x, graph.internal_node(node).pos_y);
+                ++num_distinct;
+            }
+        }
+        return num_distinct;
+    }
+
+    /// straight-line distance to the closest target: the minimum of consistent heuristics is consistent, so every
+    /// settled node - in particular every target - has its exact distance, whichever target it belongs to
+    auto nearest_target_heuristic(const ShortestPaths& graph, const MultiTargetWorkspace& ws)
+    {
+        return search::UserHeuristic{[&graph, &ws](size_t node) {
+            float nearest = INFINITY;
+            for (const auto& [x, y] : ws.positions)
+                nearest = std::min(nearest, std::hypot(x-graph.internal_node(node).pos_x, y-graph.internal_node(node).pos_y));
+            return nearest;
+        }};
+    }
+
+    ShortestPaths::Route route_to(const ShortestPaths& graph, const ShortestPaths::SearchWorkspace& ws, size_t target)
+    {
+        ShortestPaths::Route route {search::extract_path(ws, target), ws.dists[target]};
+        for (size_t& node : route.path)
+            node = graph.to_external(node);
+        return route;
+    }
+}
+
+ShortestPaths::Route ShortestPaths::compute_shortest_path_to_any(size_t from, std::span<const size_t> targets) const
+{
+    if (from >= size())
+        throw std::out_of_range("node id out of range");
+    thread_local MultiTargetWorkspace ws;
+    if (prepare_targets(*this, targets, ws) == 0)
+        return {{}, INFINITY};
+
+    std::optional<size_t> nearest;
+    const auto first_target = [&](size_t node) {
+        if (ws.is_target[node])
+            nearest = node;
+        return nearest.has_value();
+    };
+    search::NoStats stats;
+    search::run(ws.search, size(), to_internal(from), first_target, nearest_target_heuristic(*this, ws), stats, search::OutgoingEdges(*this));
+    if (!nearest)
+        return {{}, INFINITY};
+    return route_to(*this, ws.search, *nearest);
+}
+
+std::vector<ShortestPaths::Route> ShortestPaths::compute_shortest_paths_to_all(size_t from, std::span<const size_t> targets) const
+{
+    if (from >= size())
+        throw std::out_of_range("node id out of range");
+    thread_local MultiTargetWorkspace ws;
+    size_t remaining = prepare_targets(*this, targets, ws);
+    if (remaining == 0)
+        return {};
+
+    const auto last_target = [&](size_t node) { return ws.is_target[node] && --remaining == 0; };
+    search::NoStats stats;
+    search::run(ws.search, size(), to_internal(from), last_target, nearest_target_heuristic(*this, ws), stats, search::OutgoingEdges(*this));
+
+    std::vector<Route> routes;
+    routes.reserve(ws.targets.size());
+    for (size_t target : ws.targets)
+        routes.push_back(route_to(*this, ws.search, target));
+    return routes;
+}
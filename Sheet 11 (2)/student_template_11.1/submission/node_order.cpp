@@ -0,0 +1,227 @@
+#include "shortest_paths.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    /// position of (x, y) along the Hilbert curve that fills the 2^16 x 2^16 grid
+    uint64_t hilbert_index(uint32_t x, uint32_t y)
+    {
+        constexpr uint32_t n = 1u << 16;
+        uint64_t d = 0;
+        for (uint32_t s=n/2; s>0; s/=2) {
+            const uint32_t rx = (x & s) > 0;
+            const uint32_t ry = (y & s) > 0;
+            d += static_cast<uint64_t>(s)*s*((3*rx)^ry);
+            // rotate the quadrant so that the curve continues in the right orientation
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = n-1-x;
+                    y = n-1-y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+
+    std::vector<size_t> hilbert_order(const ShortestPaths& graph)
+    {
+        const size_t num_nodes = graph.size();
+        float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+        for (size_t i=0; i<num_nodes; ++i) {
+            min_x = std::min(min_x, graph.internal_node(i).pos_x);
+            max_x = std::max(max_x, graph.internal_node(i).pos_x);
+            min_y = std::min(min_y, graph.internal_node(i).pos_y);
+            max_y = std::max(max_y, graph.internal_node(i).pos_y);
+        }
+        // one scale for both axes keeps the curve from being stretched
+        const float extent = std::max(max_x-min_x, max_y-min_y);
+        const float scale = extent > 0.0f ? 65535.0f/extent : 0.0f;
+
+        std::vector<std::pair<uint64_t, size_t>> keys(num_nodes);
+        for (size_t i=0; i<num_nodes; ++i) {
+            const auto x = static_cast<uint32_t>((graph.internal_node(i).pos_x-min_x)*scale);
+            const auto y = static_cast<uint32_t>((graph.internal_node(i).pos_y-min_y)*scale);
+            keys[i] = {hilbert_index(x, y), i};
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<size_t> order(num_nodes);
+        for (size_t i=0; i<num_nodes; ++i)
+            order[i] = keys[i].second;
+        return order;
+    }
+
+    /// neighbors over edges in either direction, sorted by id
+    std::vector<std::vector<size_t>> undirected_neighbors(const ShortestPaths& graph)
+    {
+        const size_t num_nodes = graph.size();
+        std::vector<std::vector<size_t>> neighbors(num_nodes);
+        for (size_t u=0; u<num_nodes; ++u)
+            for (size_t v=0; v<num_nodes; ++v)
+                if (u != v && (graph.internal_node(u).row()[v] || graph.internal_node(v).row()[u]))
+                    neighbors[u].push_back(v);
+        return neighbors;
+    }
+
+    struct Traversal {
+        /// nodes of the deepest BFS level
+        std::vector<size_t> last_level;
+        size_t num_levels = 0;
+    };
+
+    /// breadth-first traversal from root that appends all newly reached nodes to order;
+    /// sort_neighbors may reorder the newly reached neighbors of each node
+    template <typename NeighborOrder>
+    Traversal traverse(const std::vector<std::vector<size_t>>& neighbors, size_t root, std::vector<bool>& reached, std::vector<size_t>& order, NeighborOrder&& sort_neighbors)
+    {
+        Traversal result;
+        std::vector<size_t> level {root};
+        std::vector<size_t> next;
+        reached[root] = true;
+        order.push_back(root);
+        while (true) {
+            ++result.num_levels;
+            next.clear();
+            for (size_t u : level) {
+                const auto begin = static_cast<std::ptrdiff_t>(order.size());
+                for (size_t v : neighbors[u]) {
+                    if (!reached[v]) {
+                        reached[v] = true;
+                        order.push_back(v);
+                    }
+                }
+                sort_neighbors(order.begin()+begin, order.end());
+                next.insert(next.end(), order.begin()+begin, order.end());
+            }
+            if (next.empty()) {
+                result.last_level = std::move(level);
+                return result;
+            }
+            std::swap(level, next);
+        }
+    }
+
+    std::vector<size_t> bfs_order(const ShortestPaths& graph)
+    {
+        const auto neighbors = undirected_neighbors(graph);
+        std::vector<bool> reached(graph.size(), false);
+        std::vector<size_t> order;
+        order.reserve(graph.size());
+        for (size_t root=0; root<graph.size(); ++root)
+            if (!reached[root])
+                traverse(neighbors, root, reached, order, [](auto, auto) {});
+        return order;
+    }
+
+    std::vector<size_t> rcm_order(const ShortestPaths& graph)
+    {
+        const size_t num_nodes = graph.size();
+        const auto neighbors = undirected_neighbors(graph);
+        const auto by_degree = [&](auto begin, auto end) {
+            std::stable_sort(begin, end, [&](size_t a, size_t b) { return neighbors[a].size() < neighbors[b].size(); });
+        };
+
+        std::vector<bool> reached(num_nodes, false);
+        std::vector<bool> scratch(num_nodes, false);
+        std::vector<size_t> component;
+        std::vector<size_t> order;
+        order.reserve(num_nodes);
+        for (size_t start=0; start<num_nodes; ++start) {
+            if (reached[start])
+                continue;
+
+            // pseudo-peripheral root: restart from a minimum degree node of the last BFS level
+            // as long as that increases the eccentricity (George-Liu)
+            size_t root = start;
+            size_t depth = 0;
+            for (size_t iteration=0; iteration<8; ++iteration) {
+                component.clear();
+                const Traversal traversal = traverse(neighbors, root, scratch, component, [](auto, auto) {});
+                for (size_t node : component)
+                    scratch[node] = false;
+                if (iteration > 0 && traversal.num_levels <= depth)
+                    break;
+                depth = traversal.num_levels;
+                root = *std::min_element(traversal.last_level.begin(), traversal.last_level.end(), [&](size_t a, size_t b) { return neighbors[a].size() < neighbors[b].size(); });
+            }
+
+            traverse(neighbors, root, reached, order, by_degree);
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+}
+
+void ShortestPaths::reorder(NodeOrder strategy)
+{
+    const size_t num_nodes = size();
+    std::vector<size_t> order; // order[new id] = old id
+    switch (strategy) {
+        case NodeOrder::Hilbert: order = hilbert_order(*this); break;
+        case NodeOrder::BFS: order = bfs_order(*this); break;
+        case NodeOrder::RCM: order = rcm_order(*this); break;
+    }
+    if (order.size() != num_nodes)
+        throw std::logic_error("node order is not a permutation");
+
+    // 1. permute the columns (edge targets) of every row
+    std::vector<std::optional<float>> row(num_nodes);
+    for (Location& location : adjacency_matrix) {
+        for (size_t j=0; j<num_nodes; ++j)
+            row[j] = location.distances[order[j]];
+        location.distances.swap(row);
+    }
+
+    // 2. permute the rows, moving a Location does not copy its edges
+    std::vector<Location> permuted;
+    permuted.reserve(num_nodes);
+    for (size_t old_id : order)
+        permuted.push_back(std::move(adjacency_matrix[old_id]));
+    adjacency_matrix = std::move(permuted);
+
+    // 3. compose the id map with the permutation
+    std::vector<size_t> new_external(num_nodes);
+    for (size_t i=0; i<num_nodes; ++i)
+        new_external[i] = to_external(order[i]);
+    external_ids = std::move(new_external);
+    internal_ids.assign(num_nodes, 0);
+    for (size_t i=0; i<num_nodes; ++i)
+        internal_ids[external_ids[i]] = i;
+    share_id_map();
+
+    if (!spatial_index.empty())
+        build_spatial_index();
+}
+
+void ShortestPaths::resize_id_map(size_t num_nodes)
+{
+    // shrinking drops the last storage slots, which is only possible if their nodes are the ones with the largest original ids
+    for (size_t i=0; i<std::min(num_nodes, external_ids.size()); ++i)
+        if (external_ids[i] >= num_nodes)
+            throw std::logic_error("cannot shrink a reordered graph below one of its original ids");
+
+    // added nodes keep their id
+    const size_t old_size = external_ids.size();
+    external_ids.resize(num_nodes);
+    for (size_t i=old_size; i<num_nodes; ++i)
+        external_ids[i] = i;
+    internal_ids.assign(num_nodes, 0);
+    for (size_t i=0; i<num_nodes; ++i)
+        internal_ids[external_ids[i]] = i;
+}
+
+void ShortestPaths::share_id_map()
+{
+    const auto ids = internal_ids.empty() ? nullptr : std::make_shared<const std::vector<size_t>>(internal_ids);
+    for (Location& location : adjacency_matrix)
+        location.internal_ids = ids;
+}
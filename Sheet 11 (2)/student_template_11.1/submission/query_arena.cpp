@@ -0,0 +1,50 @@
+#include "query_arena.h"
+#include "search_kernel.h"
+#include "shortest_paths.h"
+
+QueryArena::QueryArena(size_t initial_bytes)
+    : buffer(initial_bytes)
+{
+    arena.emplace(buffer.data(), buffer.size(), &overflow);
+}
+
+void QueryArena::reset()
+{
+    if (overflow.allocated == 0) {
+        arena->release();
+        return;
+    }
+    // grow once to everything the last query needed, the monotonic growth makes this an upper bound
+    arena.reset();
+    buffer = std::vector<std::byte>(buffer.size()+overflow.allocated);
+    overflow.allocated = 0;
+    arena.emplace(buffer.data(), buffer.size(), &overflow);
+}
+
+QueryArena& QueryArena::this_thread()
+{
+    thread_local QueryArena arena;
+    return arena;
+}
+
+void* QueryArena::OverflowResource::do_allocate(size_t bytes, size_t alignment)
+{
+    allocated += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void QueryArena::OverflowResource::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+std::pmr::vector<size_t> ShortestPaths::compute_shortest_path(size_t from, size_t to, std::pmr::memory_resource* resource) const
+{
+    if (!resource) {
+        QueryArena& arena = QueryArena::this_thread();
+        arena.reset();
+        resource = arena.resource();
+    }
+    search::NoStats stats;
+    return search::shortest_path(*this, from, to, search::EuclideanHeuristic(*this, to_internal(to)), stats, resource);
+}
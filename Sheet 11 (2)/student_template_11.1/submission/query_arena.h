@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+/// Per-query arena: a monotonic buffer whose memory is handed out linearly and released all at once by reset().
+/// The buffer grows to the high-water mark of the queries served so far, so after a few queries reset() no longer
+/// allocates and the queries themselves never reach the global heap.
+class QueryArena {
+public:
+    explicit QueryArena(size_t initial_bytes = 1 << 16);
+    QueryArena(const QueryArena&) = delete;
+    QueryArena& operator=(const QueryArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &*arena; }
+    /// invalidates everything allocated since the last reset
+    void reset();
+
+    /// bytes currently reserved for the arena
+    size_t capacity() const { return buffer.size(); }
+
+    /// the arena of the calling thread
+    static QueryArena& this_thread();
+
+private:
+    /// forwards to the global heap and remembers how much the arena needed beyond its buffer
+    class OverflowResource : public std::pmr::memory_resource {
+    public:
+        size_t allocated = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    std::vector<std::byte> buffer;
+    OverflowResource overflow;
+    std::optional<std::pmr::monotonic_buffer_resource> arena;
+};
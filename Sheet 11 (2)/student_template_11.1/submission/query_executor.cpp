@@ -0,0 +1,121 @@
+#include "query_executor.h"
+#include "shortest_paths.h"
+#include "search_kernel.h"
+#include <exception>
+#include <utility>
+
+QueryExecutor::QueryExecutor(size_t num_threads, size_t queue_capacity)
+    : capacity(queue_capacity)
+{
+    if (num_threads == 0 || queue_capacity == 0)
+        throw std::invalid_argument("the executor needs at least one thread and one queue slot");
+    workers.reserve(num_threads);
+    for (size_t i=0; i<num_threads; ++i)
+        workers.emplace_back([this] { work(); });
+}
+
+QueryExecutor::~QueryExecutor()
+{
+    std::deque<Job> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        std::swap(dropped, jobs);
+    }
+    not_empty.notify_all();
+    not_full.notify_all();
+    for (Job& job : dropped)
+        job(false);
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void QueryExecutor::submit(Job job)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return jobs.size() < capacity || stopping; });
+        if (stopping)
+            throw std::logic_error("executor is shutting down");
+        jobs.push_back(std::move(job));
+    }
+    not_empty.notify_one();
+}
+
+bool QueryExecutor::try_submit(Job& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.size() >= capacity || stopping)
+            return false;
+        jobs.push_back(std::move(job));
+    }
+    not_empty.notify_one();
+    return true;
+}
+
+void QueryExecutor::work()
+{
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this] { return !jobs.empty() || stopping; });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        not_full.notify_one();
+        job(true);
+    }
+}
+
+void ShortestPaths::start_executor(size_t num_threads, size_t queue_capacity)
+{
+    executor = std::make_shared<QueryExecutor>(num_threads, queue_capacity);
+}
+
+AsyncResult<std::vector<size_t>> ShortestPaths::async_compute_shortest_path(size_t from, size_t to) const
+{
+    if (!executor)
+        throw std::logic_error("call start_executor() before submitting asynchronous queries");
+    if (from >= size() || to >= size())
+        throw std::out_of_range("node id out of range");
+
+    using Result = AsyncResult<std::vector<size_t>>;
+    auto state = std::make_shared<Result::State>();
+    Result result(state);
+    executor->submit([this, state, from, to](bool run) {
+        if (!run || state->cancelled) {
+            state->set_exception(std::make_exception_ptr(QueryCancelled{}));
+            return;
+        }
+        std::vector<size_t> path;
+        std::exception_ptr error;
+        try {
+            thread_local SearchWorkspace ws;
+            search::NoStats stats;
+            const size_t target = to_internal(to);
+            const bool finished = search::run(ws, size(), to_internal(from), target, search::EuclideanHeuristic(*this, target), stats,
+                                              search::OutgoingEdges(*this), [&] { return state->cancelled.load(std::memory_order_relaxed); });
+            if (finished) {
+                path = search::extract_path(ws, target);
+                for (size_t& node : path)
+                    node = to_external(node);
+            }
+            else
+                error = std::make_exception_ptr(QueryCancelled{});
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        // completing the state resumes an awaiting coroutine, so it must not happen inside the try block: an
+        // exception from there would be set on the already satisfied promise
+        if (error)
+            state->set_exception(error);
+        else
+            state->set_value(std::move(path));
+    });
+    return result;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/// thrown by AsyncResult::get() if the query was cancelled before it finished
+class QueryCancelled : public std::runtime_error {
+public:
+    QueryCancelled() : std::runtime_error("query cancelled") {}
+};
+
+/// Fixed pool of worker threads with a bounded job queue. submit() blocks while the queue is full, so producers are
+/// slowed down to the rate at which queries are answered (backpressure); try_submit() refuses instead.
+/// The destructor finishes the running jobs and drops the queued ones (their results report QueryCancelled).
+class QueryExecutor {
+public:
+    QueryExecutor(size_t num_threads, size_t queue_capacity);
+    ~QueryExecutor();
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    /// a job is called with true to run, or with false if it is dropped at shutdown
+    using Job = std::function<void(bool run)>;
+
+    void submit(Job job);
+    /// returns false (and leaves job untouched) if the queue is full
+    bool try_submit(Job& job);
+
+    size_t num_threads() const { return workers.size(); }
+    size_t queue_capacity() const { return capacity; }
+
+private:
+    void work();
+
+    const size_t capacity;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+/// Result of an asynchronous query: a std::future that can also be cancelled and awaited in a C++20 coroutine.
+/// cancel() makes the search stop at its next check (once per settled node), get() then throws QueryCancelled.
+/// A coroutine that co_awaits the result is resumed on the worker thread that finished the query, after the result
+/// is set; an exception that escapes the resumption is not taken for a failure of the query.
+template <typename T>
+class AsyncResult {
+public:
+    /// state shared between the caller and the job on the executor
+    struct State {
+        std::promise<T> promise;
+        std::atomic<bool> cancelled {false};
+        std::mutex mutex;
+        bool done = false;
+        std::coroutine_handle<> waiter;
+
+        void set_value(T value) { promise.set_value(std::move(value)); complete(); }
+        void set_exception(std::exception_ptr exception) { promise.set_exception(exception); complete(); }
+
+    private:
+        void complete() {
+            std::coroutine_handle<> resume;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+                std::swap(resume, waiter);
+            }
+            if (resume)
+                resume.resume();
+        }
+    };
+
+    explicit AsyncResult(std::shared_ptr<State> s) : state(std::move(s)), future(state->promise.get_future()) {}
+
+    void cancel() { state->cancelled = true; }
+    bool cancelled() const { return state->cancelled; }
+
+    T get() { return future.get(); }
+    void wait() const { future.wait(); }
+    template <typename Rep, typename Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period>& timeout) const { return future.wait_for(timeout); }
+
+    // awaitable interface
+    bool await_ready() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->done;
+    }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->done)
+            return false;
+        state->waiter = handle;
+        return true;
+    }
+    T await_resume() { return future.get(); }
+
+private:
+    std::shared_ptr<State> state;
+    std::future<T> future;
+};
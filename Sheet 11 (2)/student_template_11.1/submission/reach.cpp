@@ -0,0 +1,283 @@
+#include "reach.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace {
+    using QueueEntry = std::pair<float, uint32_t>;
+    constexpr auto queue_order = std::greater<QueueEntry>{};
+    constexpr uint32_t not_settled = std::numeric_limits<uint32_t>::max();
+
+    /// relative tolerance for rounding errors: in the comparison of distances along different paths and on the bounds
+    constexpr float tolerance = 1e-5f;
+    constexpr float bound_slack = 1e-4f;
+
+    /// the graph as compressed sparse rows over the internal ids
+    struct Edges {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> targets;
+        std::vector<float> weights;
+        /// longest outgoing edge of every node
+        std::vector<float> longest;
+        /// longest path into (out of) every node through a deleted neighbour, counted with the reach bound of that
+        /// neighbour: bound(u)+w(u, v) over the deleted u with an edge u -> v (bound(w)+w(v, w) over v -> w)
+        std::vector<float> in_penalty;
+        std::vector<float> out_penalty;
+    };
+
+    /// the subgraph of the nodes without a reach bound yet, the bounded nodes are deleted and replaced by penalties
+    Edges shrink(const Edges& full, const std::vector<float>& bounds)
+    {
+        const size_t num_nodes = bounds.size();
+        Edges edges;
+        edges.offsets.assign(num_nodes+1, 0);
+        edges.longest.assign(num_nodes, 0.0f);
+        edges.in_penalty.assign(num_nodes, 0.0f);
+        edges.out_penalty.assign(num_nodes, 0.0f);
+        for (size_t u=0; u<num_nodes; ++u) {
+            const bool deleted = std::isfinite(bounds[u]);
+            for (uint32_t e=full.offsets[u]; e<full.offsets[u+1]; ++e) {
+                const uint32_t v = full.targets[e];
+                const float weight = full.weights[e];
+                if (deleted) {
+                    if (!std::isfinite(bounds[v]))
+                        edges.in_penalty[v] = std::max(edges.in_penalty[v], bounds[u]+weight);
+                } else if (std::isfinite(bounds[v])) {
+                    edges.out_penalty[u] = std::max(edges.out_penalty[u], bounds[v]+weight);
+                } else {
+                    edges.targets.push_back(v);
+                    edges.weights.push_back(weight);
+                    edges.longest[u] = std::max(edges.longest[u], weight);
+                }
+            }
+            edges.offsets[u+1] = static_cast<uint32_t>(edges.targets.size());
+        }
+        return edges;
+    }
+
+    /// scratch memory of the partial trees of one thread, only the touched entries are reset between trees
+    struct Tree {
+        std::vector<float> dists;
+        std::vector<float> heights;
+        /// position of every node in the settling order, not_settled if it is not in the tree
+        std::vector<uint32_t> rank;
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> touched;
+        std::vector<QueueEntry> queue;
+
+        explicit Tree(size_t num_nodes) : dists(num_nodes, INFINITY), heights(num_nodes), rank(num_nodes, not_settled) {}
+
+        /// Dijkstra from source until every node up to radius is settled; returns whether the tree spans all nodes
+        /// reachable from source
+        bool grow(const Edges& edges, uint32_t source, float radius)
+        {
+            dists[source] = 0.0f;
+            touched.push_back(source);
+            queue.push_back({0.0f, source});
+            while (!queue.empty()) {
+                const auto [dist, u] = queue.front();
+                if (rank[u] != not_settled) {
+                    std::pop_heap(queue.begin(), queue.end(), queue_order);
+                    queue.pop_back();
+                    continue;
+                }
+                if (dist > radius)
+                    return false;
+                std::pop_heap(queue.begin(), queue.end(), queue_order);
+                queue.pop_back();
+                rank[u] = static_cast<uint32_t>(order.size());
+                order.push_back(u);
+                for (uint32_t e=edges.offsets[u]; e<edges.offsets[u+1]; ++e) {
+                    const uint32_t v = edges.targets[e];
+                    const float new_dist = dist+edges.weights[e];
+                    if (new_dist < dists[v]) {
+                        if (dists[v] == INFINITY)
+                            touched.push_back(v);
+                        dists[v] = new_dist;
+                        queue.push_back({new_dist, v});
+                        std::push_heap(queue.begin(), queue.end(), queue_order);
+                    }
+                }
+            }
+            return true;
+        }
+
+        /// raises reach[v] to min(depth, height) of every settled node v. The height is taken over all shortest
+        /// paths within the tree; edges leaving the tree count with their full weight, as they may start a shortest
+        /// path that continues outside of it. The penalties stand in for the paths through deleted nodes: the depth
+        /// starts at the in-penalty of the source and every node may end a path with its out-penalty.
+        void collect(const Edges& edges, std::vector<float>& reach)
+        {
+            const float source_penalty = edges.in_penalty[order.front()];
+            for (size_t i=order.size(); i-- > 0;) {
+                const uint32_t u = order[i];
+                float height = edges.out_penalty[u];
+                for (uint32_t e=edges.offsets[u]; e<edges.offsets[u+1]; ++e) {
+                    const uint32_t v = edges.targets[e];
+                    const float weight = edges.weights[e];
+                    if (rank[v] == not_settled)
+                        height = std::max(height, weight+edges.out_penalty[v]);
+                    else if (v != u && dists[u]+weight <= dists[v]*(1.0f+tolerance)) {
+                        // a zero-weight edge back to a node settled before u, whose height is not known yet
+                        if (rank[v] < i)
+                            height = INFINITY;
+                        else
+                            height = std::max(height, weight+heights[v]);
+                    }
+                }
+                heights[u] = height;
+                reach[u] = std::max(reach[u], std::min(dists[u]+source_penalty, height));
+            }
+        }
+
+        void clear()
+        {
+            for (uint32_t v : touched) {
+                dists[v] = INFINITY;
+                rank[v] = not_settled;
+            }
+            touched.clear();
+            order.clear();
+            queue.clear();
+        }
+    };
+}
+
+ReachIndex::ReachIndex(const ShortestPaths& graph, const Options& options)
+{
+    TRACE_SCOPE("reach preprocessing");
+    const auto start = std::chrono::steady_clock::now();
+    if (!(options.growth > 1.0f))
+        throw std::invalid_argument("the threshold has to grow between the rounds");
+    if (!(options.initial_threshold >= 0.0f))
+        throw std::invalid_argument("the initial threshold must not be negative");
+    if (!(options.max_threshold >= 0.0f))
+        throw std::invalid_argument("the maximum threshold must not be negative");
+    const size_t num_nodes = graph.size();
+    if (num_nodes >= std::numeric_limits<uint32_t>::max())
+        throw std::length_error("too many nodes for the reach index");
+    const size_t num_threads = options.num_threads > 0 ? options.num_threads : std::max(1u, std::thread::hardware_concurrency());
+
+    // 1. outgoing edges in internal ids
+    Edges full;
+    full.offsets.assign(num_nodes+1, 0);
+    for (size_t u=0; u<num_nodes; ++u) {
+        const auto& row = graph.internal_node(u).row();
+        for (size_t v=0; v<num_nodes; ++v)
+            if (row[v]) {
+                full.targets.push_back(static_cast<uint32_t>(v));
+                full.weights.push_back(*row[v]);
+            }
+        full.offsets[u+1] = static_cast<uint32_t>(full.targets.size());
+    }
+
+    double mean_weight = 1.0;
+    if (!full.weights.empty()) {
+        double sum = 0.0;
+        for (float weight : full.weights)
+            sum += static_cast<double>(weight);
+        if (sum > 0.0)
+            mean_weight = sum/static_cast<double>(full.weights.size());
+    }
+    float threshold = options.initial_threshold > 0.0f ? options.initial_threshold : static_cast<float>(mean_weight);
+    const float max_threshold = options.max_threshold > 0.0f ? options.max_threshold
+        : static_cast<float>(4.0*mean_weight*std::sqrt(static_cast<double>(num_nodes)));
+
+    // 2. rounds of partial trees from the nodes without a bound, in the graph without the bounded nodes
+    bounds.assign(num_nodes, INFINITY);
+    std::vector<uint32_t> remaining(num_nodes);
+    for (size_t v=0; v<num_nodes; ++v)
+        remaining[v] = static_cast<uint32_t>(v);
+    std::vector<std::vector<float>> reach(num_threads);
+    while (!remaining.empty()) {
+        TRACE_SCOPE("reach round");
+        ++stats.rounds;
+        const Edges edges = shrink(full, bounds);
+        // every thread takes the next block of sources and keeps the maxima of its own trees
+        std::atomic<size_t> next_source {0};
+        std::atomic<size_t> settled {0};
+        std::atomic<bool> complete {true};
+        constexpr size_t block_size = 64;
+        std::vector<std::thread> threads;
+        for (size_t t=0; t<num_threads; ++t) {
+            threads.emplace_back([&, t] {
+                reach[t].assign(num_nodes, 0.0f);
+                Tree tree(num_nodes);
+                size_t num_settled = 0;
+                bool spans_all = true;
+                for (size_t first = next_source.fetch_add(block_size); first < remaining.size(); first = next_source.fetch_add(block_size)) {
+                    for (size_t i=first; i<std::min(first+block_size, remaining.size()); ++i) {
+                        const uint32_t s = remaining[i];
+                        spans_all = tree.grow(edges, s, 2.0f*threshold+edges.longest[s]) && spans_all;
+                        tree.collect(edges, reach[t]);
+                        num_settled += tree.order.size();
+                        tree.clear();
+                    }
+                }
+                settled += num_settled;
+                if (!spans_all)
+                    complete = false;
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        stats.settled += settled;
+
+        // a node whose reach in all trees is below the threshold has at most that reach; if the trees spanned
+        // everything, they contain every shortest path and the reach is known for all nodes. The bounded nodes are
+        // deleted for the next round.
+        std::vector<uint32_t> unbounded;
+        for (uint32_t v : remaining) {
+            float maximum = 0.0f;
+            for (const std::vector<float>& thread_reach : reach)
+                maximum = std::max(maximum, thread_reach[v]);
+            if (complete || maximum < threshold)
+                bounds[v] = maximum*(1.0f+bound_slack);
+            else
+                unbounded.push_back(v);
+        }
+        remaining = std::move(unbounded);
+        if (threshold >= max_threshold)
+            break;
+        threshold = std::min(threshold*options.growth, max_threshold);
+    }
+
+    stats.unbounded = remaining.size();
+    stats.memory_bytes = bounds.size()*sizeof(float);
+    stats.build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+std::vector<size_t> ShortestPaths::compute_shortest_path(size_t from, size_t to, const ReachIndex& reach) const
+{
+    TRACE_SCOPE("compute_shortest_path");
+    if (reach.size() != size())
+        throw std::invalid_argument("the reach index belongs to a different graph");
+    from = to_internal(from);
+    to = to_internal(to);
+
+    // A* with the straight-line distance, which also serves as the lower bound for the pruning
+    thread_local SearchWorkspace ws;
+    search::CountingStats stats;
+    const search::EuclideanHeuristic heuristic(*this, to);
+    search::run<search::BinaryHeap>(ws, size(), from, to, heuristic, stats, search::ReachPrunedEdges(reach, ws, search::OutgoingEdges(*this), heuristic));
+    TRACE_COUNTER("nodes settled", stats.num_settled);
+    TRACE_COUNTER("edges relaxed", stats.num_relaxed);
+    TRACE_COUNTER("heuristic evaluations", stats.num_heuristic_evaluations);
+
+    std::vector<size_t> result = search::extract_path(ws, to);
+
+    std::cout << "Distance: " << ws.dists.at(to) << std::endl;
+    std::cout << "Nodes visited: " << stats.num_settled << std::endl;
+
+    for (size_t& node : result)
+        node = to_external(node);
+    return result;
+}
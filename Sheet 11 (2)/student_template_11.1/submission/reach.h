@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "shortest_paths.h"
+#include "search_kernel.h"
+
+/// Upper bounds on the reach of every node for pruning point-to-point queries.
+/// The reach of v is the maximum of min(d(s, v), d(v, t)) over all shortest paths s -> t through v. A query from s to
+/// t can skip v if its reach is below both d(s, v) and a lower bound on d(v, t), as v then lies on no shortest path
+/// between them. Nodes in the middle of long routes (highways) have a high reach, local side streets a low one.
+///
+/// The bounds are computed from partial shortest-path trees in rounds with a growing threshold eps (Gutman, with the
+/// shrinking of Goldberg et al.): every round grows a tree from every node that is not bounded yet, up to 2*eps plus
+/// its longest outgoing edge, and takes, for every node v, the maximum of min(depth, height) over all trees (heights
+/// over all shortest paths, so ties are covered). If that maximum is below eps, it is an upper bound on the reach of v,
+/// otherwise v is left for the next round. The bounded nodes are deleted from the graph of the following rounds; the
+/// paths through them are accounted for by penalties, the longest bound(u)+w(u, v) into a node from a deleted
+/// neighbour u starts the depth of a tree and the longest bound(w)+w(v, w) out of it ends a height. The rounds stop
+/// once the trees cover all reachable nodes (the remaining bounds are then exact up to rounding and the penalties) or
+/// eps exceeds Options::max_threshold, the remaining nodes are never pruned. The trees of a round are grown in parallel.
+///
+/// Node ids are internal ids (see ShortestPaths::reorder), as for the search kernel.
+class ReachIndex {
+public:
+    struct Options {
+        /// threshold of the first round, 0 for the mean edge weight
+        float initial_threshold = 0.0f;
+        /// factor between the thresholds of consecutive rounds (> 1)
+        float growth = 2.0f;
+        /// nodes that are not bounded by a round with at most this threshold keep an infinite reach; 0 for four times
+        /// the mean edge weight times sqrt(number of nodes), about the diameter of a road network, INFINITY to bound
+        /// every node
+        float max_threshold = 0.0f;
+        /// 0 for std::thread::hardware_concurrency()
+        size_t num_threads = 0;
+    };
+
+    /// sizes and timings of the preprocessing
+    struct BuildStats {
+        double build_seconds = 0.0;
+        size_t rounds = 0;
+        /// nodes settled in all partial trees of all rounds
+        size_t settled = 0;
+        /// nodes with an infinite reach bound
+        size_t unbounded = 0;
+        size_t memory_bytes = 0;
+    };
+
+    ReachIndex() = default;
+    explicit ReachIndex(const ShortestPaths& graph) : ReachIndex(graph, Options{}) {}
+    ReachIndex(const ShortestPaths& graph, const Options& options);
+
+    size_t size() const { return bounds.size(); }
+    /// upper bound on the reach of node (internal id), infinite if unknown
+    float bound(size_t node) const { return bounds[node]; }
+    const BuildStats& build_stats() const { return stats; }
+
+private:
+    std::vector<float> bounds;
+    BuildStats stats;
+};
+
+namespace search {
+
+    /// Edges policy that drops the edges towards nodes whose reach bound is below both their tentative distance from
+    /// the source and lower_bound(node), any admissible estimate of the distance to the target; the remaining edges
+    /// come from the wrapped edges. Needs the workspace of the search for the distance of the node being scanned.
+    /// Combines with every heuristic, e.g. A* with the same lower bound:
+    ///     run(ws, n, s, t, EuclideanHeuristic(g, t), stats, ReachPrunedEdges(reach, ws, OutgoingEdges(g), EuclideanHeuristic(g, t)))
+    template <typename Edges, typename LowerBound>
+    class ReachPrunedEdges {
+    public:
+        ReachPrunedEdges(const ReachIndex& r, const ShortestPaths::SearchWorkspace& w, const Edges& e, const LowerBound& l)
+            : reach(r), ws(w), edges(e), lower_bound(l) {}
+        template <typename Visitor>
+        void operator()(size_t u, Visitor&& visit) const {
+            const float dist = ws.dists[u];
+            edges(u, [&](size_t v, float weight) {
+                const float bound = reach.bound(v);
+                if (bound < dist+weight && bound < lower_bound(v))
+                    return;
+                visit(v, weight);
+            });
+        }
+
+    private:
+        const ReachIndex& reach;
+        const ShortestPaths::SearchWorkspace& ws;
+        Edges edges;
+        LowerBound lower_bound;
+    };
+}
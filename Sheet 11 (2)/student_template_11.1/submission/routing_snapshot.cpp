@@ -0,0 +1,186 @@
+#include "shortest_paths.h"
+#include "binary_io.h"
+#include "routing_snapshot.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void ShortestPaths::build_spatial_index()
+{
+    std::vector<float> xs, ys;
+    xs.reserve(size());
+    ys.reserve(size());
+    for (const Location& location : adjacency_matrix) {
+        xs.push_back(location.pos_x);
+        ys.push_back(location.pos_y);
+    }
+    spatial_index = SpatialIndex(xs, ys);
+}
+
+size_t ShortestPaths::nearest_node(float x, float y) const
+{
+    if (spatial_index.size() != size())
+        throw std::logic_error("spatial index is not built");
+    const auto node = spatial_index.nearest(x, y);
+    if (!node)
+        throw std::runtime_error("graph is empty");
+    return to_external(*node);
+}
+
+std::vector<size_t> ShortestPaths::nodes_in_radius(float x, float y, float r) const
+{
+    if (spatial_index.size() != size())
+        throw std::logic_error("spatial index is not built");
+    std::vector<size_t> nodes = spatial_index.in_radius(x, y, r);
+    for (size_t& node : nodes)
+        node = to_external(node);
+    return nodes;
+}
+
+void ShortestPaths::save_snapshot(const std::string& filename) const
+{
+    std::ofstream file(filename, std::ofstream::out|std::ofstream::trunc|std::ofstream::binary);
+    if (!file)
+        throw std::runtime_error("cannot open "+filename);
+    const size_t num_nodes = size();
+    if (num_nodes >= std::numeric_limits<uint32_t>::max())
+        throw std::length_error("too many nodes for a snapshot");
+
+    routing_snapshot::write_header(file, num_nodes);
+
+    // 1. node names and positions
+    for (const Location& location : adjacency_matrix)
+        routing_snapshot::write_name(file, location.name);
+    std::vector<float> xs, ys;
+    xs.reserve(num_nodes);
+    ys.reserve(num_nodes);
+    for (const Location& location : adjacency_matrix) {
+        xs.push_back(location.pos_x);
+        ys.push_back(location.pos_y);
+    }
+    binary_io::write_array(file, xs);
+    binary_io::write_array(file, ys);
+
+    // 2. edges as compressed sparse rows
+    std::vector<uint64_t> offsets {0};
+    std::vector<uint32_t> targets;
+    std::vector<float> weights;
+    offsets.reserve(num_nodes+1);
+    for (const Location& location : adjacency_matrix) {
+        for (size_t to=0; to<num_nodes; ++to) {
+            if (const auto& weight = location.distances[to]) {
+                targets.push_back(static_cast<uint32_t>(to));
+                weights.push_back(*weight);
+            }
+        }
+        offsets.push_back(targets.size());
+    }
+    binary_io::write_array(file, offsets);
+    binary_io::write_array(file, targets);
+    binary_io::write_array(file, weights);
+
+    // 3. original ids of the stored nodes (empty if never reordered)
+    std::vector<uint32_t> ids(external_ids.begin(), external_ids.end());
+    binary_io::write_array(file, ids);
+
+    // 4. spatial index (optional)
+    const bool has_index = !spatial_index.empty() && spatial_index.size() == num_nodes;
+    binary_io::write_value<uint8_t>(file, has_index);
+    if (has_index)
+        spatial_index.write(file);
+
+    if (!file)
+        throw std::runtime_error("writing "+filename+" failed");
+}
+
+ShortestPaths ShortestPaths::load_snapshot(const std::string& filename)
+{
+    std::ifstream file(filename, std::ifstream::in|std::ifstream::binary);
+    if (!file)
+        throw std::runtime_error("cannot open "+filename);
+
+    const size_t num_nodes = routing_snapshot::read_header(file);
+    ShortestPaths graph(num_nodes);
+
+    for (Location& location : graph.adjacency_matrix)
+        location.name = routing_snapshot::read_name(file);
+    const auto xs = binary_io::read_array<float>(file);
+    const auto ys = binary_io::read_array<float>(file);
+    if (xs.size() != num_nodes || ys.size() != num_nodes)
+        throw std::runtime_error("corrupt node positions in "+filename);
+    for (size_t i=0; i<num_nodes; ++i) {
+        graph.adjacency_matrix[i].pos_x = xs[i];
+        graph.adjacency_matrix[i].pos_y = ys[i];
+    }
+
+    const auto offsets = binary_io::read_array<uint64_t>(file);
+    const auto targets = binary_io::read_array<uint32_t>(file);
+    const auto weights = binary_io::read_array<float>(file);
+    // with sorted offsets from 0 to the number of edges, every edge index below is in range
+    if (offsets.size() != num_nodes+1 || offsets.front() != 0 || offsets.back() != targets.size() || targets.size() != weights.size()
+        || !std::is_sorted(offsets.begin(), offsets.end()))
+        throw std::runtime_error("corrupt edges in "+filename);
+    for (size_t from=0; from<num_nodes; ++from)
+        for (uint64_t e=offsets[from]; e<offsets[from+1]; ++e)
+            graph.adjacency_matrix[from].distances.at(targets.at(e)) = weights[e];
+
+    const auto ids = binary_io::read_array<uint32_t>(file);
+    if (!ids.empty()) {
+        if (ids.size() != num_nodes)
+            throw std::runtime_error("corrupt id map in "+filename);
+        graph.external_ids.assign(ids.begin(), ids.end());
+        graph.internal_ids.assign(num_nodes, 0);
+        for (size_t i=0; i<num_nodes; ++i)
+            graph.internal_ids.at(graph.external_ids[i]) = i;
+        graph.share_id_map();
+    }
+
+    if (binary_io::read_value<uint8_t>(file)) {
+        graph.spatial_index = SpatialIndex::read(file);
+        if (graph.spatial_index.size() != num_nodes)
+            throw std::runtime_error("spatial index does not match the nodes in "+filename);
+    }
+    return graph;
+}
+
+void routing_snapshot::write_header(std::ostream& stream, size_t num_nodes)
+{
+    binary_io::write_value(stream, magic);
+    binary_io::write_value(stream, version);
+    binary_io::write_value<uint64_t>(stream, num_nodes);
+}
+
+size_t routing_snapshot::read_header(std::istream& stream)
+{
+    if (binary_io::read_value<uint32_t>(stream) != magic)
+        throw std::runtime_error("not a routing snapshot");
+    if (binary_io::read_value<uint32_t>(stream) != version)
+        throw std::runtime_error("unsupported routing snapshot version");
+    const auto num_nodes = binary_io::read_value<uint64_t>(stream);
+    // every node takes at least the length of its name, its position and its edge offset
+    constexpr uint64_t min_bytes_per_node = sizeof(uint32_t)+2*sizeof(float)+sizeof(uint64_t);
+    if (num_nodes > max_nodes || num_nodes > binary_io::remaining_bytes(stream)/min_bytes_per_node)
+        throw std::runtime_error("corrupt number of nodes in routing snapshot");
+    return static_cast<size_t>(num_nodes);
+}
+
+void routing_snapshot::write_name(std::ostream& stream, const std::string& name)
+{
+    binary_io::write_value(stream, static_cast<uint32_t>(name.size()));
+    stream.write(name.data(), static_cast<std::streamsize>(name.size()));
+}
+
+std::string routing_snapshot::read_name(std::istream& stream)
+{
+    const auto length = binary_io::read_value<uint32_t>(stream);
+    if (length > binary_io::remaining_bytes(stream))
+        throw std::runtime_error("unexpected end of snapshot");
+    std::string name(length, '\0');
+    if (!stream.read(name.data(), static_cast<std::streamsize>(name.size())))
+        throw std::runtime_error("unexpected end of snapshot");
+    return name;
+}
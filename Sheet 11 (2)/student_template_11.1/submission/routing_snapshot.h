@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+/// Layout of a routing snapshot (all values in host byte order):
+///   header:  magic, version, number of nodes
+///   nodes:   names (length-prefixed), pos_x array, pos_y array
+///   edges:   CSR offsets (num_nodes+1), targets, weights
+///   ids:     original id of every stored node, empty if the nodes were never reordered
+///   index:   flag, followed by the SpatialIndex if the flag is set
+/// Arrays are prefixed with their number of elements (see binary_io::write_array).
+namespace routing_snapshot {
+
+    constexpr uint32_t magic = 0x4e535053; // "SPSN"
+    constexpr uint32_t version = 2;
+    /// the adjacency matrix of ShortestPaths would take 32 GiB for this many nodes, larger headers are corrupt
+    constexpr uint64_t max_nodes = uint64_t{1} << 16;
+
+    void write_header(std::ostream& stream, size_t num_nodes);
+    /// checks magic and version and returns the number of nodes, after checking it against max_nodes and the size
+    /// of the rest of the stream
+    size_t read_header(std::istream& stream);
+
+    void write_name(std::ostream& stream, const std::string& name);
+    std::string read_name(std::istream& stream);
+}
@@ -0,0 +1,85 @@
+#include "search_kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+search::Landmarks::Landmarks(const ShortestPaths& graph, size_t num_landmarks)
+    : num_nodes(graph.size())
+{
+    TRACE_SCOPE("landmark selection");
+    if (num_nodes == 0)
+        return;
+    num_landmarks = std::min(num_landmarks, num_nodes);
+
+    ShortestPaths::SearchWorkspace ws;
+    NoStats stats;
+    // distance of every node to the closest landmark chosen so far
+    std::vector<float> closest(num_nodes, INFINITY);
+    size_t next = 0;
+    while (landmarks.size() < num_landmarks) {
+        landmarks.push_back(next);
+        run(ws, num_nodes, next, std::nullopt, NoHeuristic{}, stats, OutgoingEdges(graph));
+        from_landmark.insert(from_landmark.end(), ws.dists.begin(), ws.dists.end());
+        run(ws, num_nodes, next, std::nullopt, NoHeuristic{}, stats, IncomingEdges(graph));
+        to_landmark.insert(to_landmark.end(), ws.dists.begin(), ws.dists.end());
+
+        // farthest selection: the next landmark is the reachable node farthest from all landmarks so far,
+        // nodes that no landmark reaches yet are preferred so that every component gets one
+        const float* dists = &from_landmark[(landmarks.size()-1)*num_nodes];
+        for (size_t v=0; v<num_nodes; ++v)
+            closest[v] = std::min(closest[v], dists[v]);
+        float farthest = -1.0f;
+        for (size_t v=0; v<num_nodes; ++v) {
+            const float score = std::isfinite(closest[v]) ? closest[v] : std::numeric_limits<float>::max();
+            if (score > farthest && std::find(landmarks.begin(), landmarks.end(), v) == landmarks.end()) {
+                farthest = score;
+                next = v;
+            }
+        }
+        if (farthest < 0.0f)
+            break;
+    }
+}
+
+search::AdjacencyLists::AdjacencyLists(const ShortestPaths& graph)
+{
+    TRACE_SCOPE("adjacency lists");
+    const size_t num_nodes = graph.size();
+    if (num_nodes >= std::numeric_limits<uint32_t>::max())
+        throw std::length_error("too many nodes for adjacency lists");
+
+    out_offsets.assign(num_nodes+1, 0);
+    in_offsets.assign(num_nodes+1, 0);
+    for (size_t u=0; u<num_nodes; ++u) {
+        const auto& row = graph.internal_node(u).row();
+        for (size_t v=0; v<num_nodes; ++v)
+            if (row[v]) {
+                out_targets.push_back(static_cast<uint32_t>(v));
+                out_weights.push_back(*row[v]);
+                ++in_offsets[v+1];
+            }
+        out_offsets[u+1] = out_targets.size();
+    }
+
+    // in_offsets[v] moves to the end of the edges into v while they are filled in and back to their begin after
+    for (size_t v=0; v<num_nodes; ++v)
+        in_offsets[v+1] += in_offsets[v];
+    in_sources.resize(out_targets.size());
+    in_weights.resize(out_targets.size());
+    for (size_t u=0; u<num_nodes; ++u)
+        for (size_t e=out_offsets[u]; e<out_offsets[u+1]; ++e) {
+            const size_t position = in_offsets[out_targets[e]]++;
+            in_sources[position] = static_cast<uint32_t>(u);
+            in_weights[position] = out_weights[e];
+        }
+    for (size_t v=num_nodes; v>0; --v)
+        in_offsets[v] = in_offsets[v-1];
+    in_offsets[0] = 0;
+}
+
+size_t search::AdjacencyLists::memory_bytes() const
+{
+    return (out_offsets.size()+in_offsets.size())*sizeof(size_t)+(out_targets.size()+in_sources.size())*sizeof(uint32_t)
+        +(out_weights.size()+in_weights.size())*sizeof(float);
+}
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "shortest_paths.h"
+#include "trace.h"
+
+/// The shortest-path kernel as a template over compile-time policies:
+///  - Heuristic: NoHeuristic (Dijkstra), EuclideanHeuristic, AltHeuristic or UserHeuristic<F> (A*)
+///  - Queue:     BinaryHeap or QuaternaryHeap
+///  - Stats:     NoStats or CountingStats
+///  - Edges:     OutgoingEdges (forward search), IncomingEdges (backward search), the same over AdjacencyLists
+///               (ListedOutgoingEdges, ListedIncomingEdges) or any type with the same interface
+///  - Interrupt: NeverInterrupt or any callable bool() that is checked once per settled node
+///  - Target:    a single node (std::nullopt for the complete tree) or any callable bool(size_t node) that says
+///               whether the search can stop after settling node
+/// Every combination is a separate instantiation, the policies are resolved at compile time.
+/// All node ids are internal ids (see ShortestPaths::reorder).
+namespace search {
+
+    // --- heuristics -------------------------------------------------------------------------------------------------
+
+    /// plain Dijkstra, no heuristic is evaluated at all
+    struct NoHeuristic {
+        static constexpr bool enabled = false;
+        float operator()(size_t) const { return 0.0f; }
+    };
+
+    /// straight-line distance towards the target, admissible if edge weights are at least the distance of their nodes
+    class EuclideanHeuristic {
+    public:
+        static constexpr bool enabled = true;
+        EuclideanHeuristic(const ShortestPaths& g, size_t target) : graph(g), target_x(g.internal_node(target).pos_x), target_y(g.internal_node(target).pos_y) {}
+        float operator()(size_t node) const {
+            const float dx = target_x-graph.internal_node(node).pos_x;
+            const float dy = target_y-graph.internal_node(node).pos_y;
+            return std::sqrt(dx*dx+dy*dy);
+        }
+
+    private:
+        const ShortestPaths& graph;
+        float target_x, target_y;
+    };
+
+    /// precomputed distances from and towards a few landmarks for the ALT (A*, landmarks, triangle inequality) heuristic
+    class Landmarks {
+    public:
+        Landmarks() = default;
+        /// picks num_landmarks nodes by farthest selection and computes their forward and backward distances
+        Landmarks(const ShortestPaths& graph, size_t num_landmarks);
+
+        size_t size() const { return landmarks.size(); }
+        /// internal ids of the landmarks
+        const std::vector<size_t>& nodes() const { return landmarks; }
+
+        /// lower bound for the distance from node to target
+        float lower_bound(size_t node, size_t target) const {
+            float bound = 0.0f;
+            for (size_t l=0; l<landmarks.size(); ++l) {
+                const float* from = &from_landmark[l*num_nodes];
+                const float* to = &to_landmark[l*num_nodes];
+                // d(L, target) <= d(L, node) + d(node, target) and d(node, L) <= d(node, target) + d(target, L)
+                const float forward = from[target]-from[node];
+                const float backward = to[node]-to[target];
+                if (std::isfinite(forward))
+                    bound = std::max(bound, forward);
+                if (std::isfinite(backward))
+                    bound = std::max(bound, backward);
+            }
+            return bound;
+        }
+
+    private:
+        size_t num_nodes = 0;
+        std::vector<size_t> landmarks;
+        /// from_landmark[l*num_nodes+v] = d(landmark l, v), to_landmark[l*num_nodes+v] = d(v, landmark l)
+        std::vector<float> from_landmark;
+        std::vector<float> to_landmark;
+    };
+
+    class AltHeuristic {
+    public:
+        static constexpr bool enabled = true;
+        AltHeuristic(const Landmarks& l, size_t t) : landmarks(l), target(t) {}
+        float operator()(size_t node) const { return landmarks.lower_bound(node, target); }
+
+    private:
+        const Landmarks& landmarks;
+        size_t target;
+    };
+
+    /// wraps any callable float(size_t node); it has to be consistent for the search to return shortest paths
+    template <typename F>
+    struct UserHeuristic {
+        static constexpr bool enabled = true;
+        F function;
+        float operator()(size_t node) const { return function(node); }
+    };
+    template <typename F>
+    UserHeuristic(F) -> UserHeuristic<F>;
+
+    // --- queues -----------------------------------------------------------------------------------------------------
+
+    /// d-ary min-heap on the (key, node) entries of a SearchWorkspace; a larger arity means fewer levels to sift through
+    template <size_t Arity>
+    struct DaryHeap {
+        using Entry = std::pair<float, size_t>;
+
+        template <typename Heap>
+        static void push(Heap& heap, Entry entry) {
+            size_t i = heap.size();
+            heap.push_back(entry);
+            while (i > 0) {
+                const size_t parent = (i-1)/Arity;
+                if (!(entry < heap[parent]))
+                    break;
+                heap[i] = heap[parent];
+                i = parent;
+            }
+            heap[i] = entry;
+        }
+
+        template <typename Heap>
+        static Entry pop(Heap& heap) {
+            const Entry top = heap.front();
+            const Entry last = heap.back();
+            heap.pop_back();
+            const size_t size = heap.size();
+            if (size == 0)
+                return top;
+            size_t i = 0;
+            while (true) {
+                const size_t first = i*Arity+1;
+                if (first >= size)
+                    break;
+                size_t smallest = first;
+                for (size_t c=first+1; c<std::min(first+Arity, size); ++c)
+                    if (heap[c] < heap[smallest])
+                        smallest = c;
+                if (!(heap[smallest] < last))
+                    break;
+                heap[i] = heap[smallest];
+                i = smallest;
+            }
+            heap[i] = last;
+            return top;
+        }
+    };
+    using BinaryHeap = DaryHeap<2>;
+    using QuaternaryHeap = DaryHeap<4>;
+
+    // --- statistics -------------------------------------------------------------------------------------------------
+
+    /// collects nothing, all calls compile to nothing
+    struct NoStats {
+        void settled() {}
+        void relaxed() {}
+        void heuristic_evaluated() {}
+    };
+
+    struct CountingStats {
+        /// nodes popped from the queue (excluding outdated entries)
+        size_t num_settled = 0;
+        /// edges that improved a tentative distance
+        size_t num_relaxed = 0;
+        size_t num_heuristic_evaluations = 0;
+
+        void settled() { ++num_settled; }
+        void relaxed() { ++num_relaxed; }
+        void heuristic_evaluated() { ++num_heuristic_evaluations; }
+    };
+
+    // --- edges ------------------------------------------------------------------------------------------------------
+
+    /// calls visit(v, weight) for every edge u->v
+    class OutgoingEdges {
+    public:
+        explicit OutgoingEdges(const ShortestPaths& g) : graph(g) {}
+        template <typename Visitor>
+        void operator()(size_t u, Visitor&& visit) const {
+            const auto& row = graph.internal_node(u).row();
+            for (size_t v=0; v<row.size(); ++v)
+                if (row[v])
+                    visit(v, *row[v]);
+        }
+
+    private:
+        const ShortestPaths& graph;
+    };
+
+    /// calls visit(v, weight) for every edge v->u, i.e. a search with these edges runs backwards
+    class IncomingEdges {
+    public:
+        explicit IncomingEdges(const ShortestPaths& g) : graph(g) {}
+        template <typename Visitor>
+        void operator()(size_t u, Visitor&& visit) const {
+            for (size_t v=0; v<graph.size(); ++v)
+                if (const auto& weight = graph.internal_node(v).row()[u])
+                    visit(v, *weight);
+        }
+
+    private:
+        const ShortestPaths& graph;
+    };
+
+    /// The edges of a graph as adjacency lists (compressed sparse rows over the internal ids) in both directions: a
+    /// list costs the degree of its node, a row of the matrix a pass over all nodes. Built once for searches that
+    /// scan many nodes or run often; it is a snapshot and has to be built again after the edges of the graph changed.
+    class AdjacencyLists {
+    public:
+        AdjacencyLists() = default;
+        explicit AdjacencyLists(const ShortestPaths& graph);
+
+        size_t size() const { return out_offsets.empty() ? 0 : out_offsets.size()-1; }
+        size_t num_edges() const { return out_targets.size(); }
+        size_t memory_bytes() const;
+
+        /// calls visit(v, weight) for every edge u->v
+        template <typename Visitor>
+        void outgoing(size_t u, Visitor&& visit) const {
+            for (size_t e=out_offsets[u]; e<out_offsets[u+1]; ++e)
+                visit(static_cast<size_t>(out_targets[e]), out_weights[e]);
+        }
+        /// calls visit(v, weight) for every edge v->u
+        template <typename Visitor>
+        void incoming(size_t u, Visitor&& visit) const {
+            for (size_t e=in_offsets[u]; e<in_offsets[u+1]; ++e)
+                visit(static_cast<size_t>(in_sources[e]), in_weights[e]);
+        }
+
+    private:
+        /// the edges leaving (entering) u are [out_offsets[u], out_offsets[u+1]) of out_targets and out_weights
+        /// ([in_offsets[u], in_offsets[u+1]) of in_sources and in_weights)
+        std::vector<size_t> out_offsets;
+        std::vector<uint32_t> out_targets;
+        std::vector<float> out_weights;
+        std::vector<size_t> in_offsets;
+        std::vector<uint32_t> in_sources;
+        std::vector<float> in_weights;
+    };
+
+    /// OutgoingEdges from adjacency lists
+    class ListedOutgoingEdges {
+    public:
+        explicit ListedOutgoingEdges(const AdjacencyLists& l) : lists(l) {}
+        template <typename Visitor>
+        void operator()(size_t u, Visitor&& visit) const { lists.outgoing(u, visit); }
+
+    private:
+        const AdjacencyLists& lists;
+    };
+
+    /// IncomingEdges from adjacency lists
+    class ListedIncomingEdges {
+    public:
+        explicit ListedIncomingEdges(const AdjacencyLists& l) : lists(l) {}
+        template <typename Visitor>
+        void operator()(size_t u, Visitor&& visit) const { lists.incoming(u, visit); }
+
+    private:
+        const AdjacencyLists& lists;
+    };
+
+    // --- interruption -----------------------------------------------------------------------------------------------
+
+    /// the search always runs to completion, the check is optimized away
+    struct NeverInterrupt {
+        constexpr bool operator()() const { return false; }
+    };
+
+    // --- targets ----------------------------------------------------------------------------------------------------
+
+    template <typename Target>
+    bool reached(const Target& target, size_t node)
+    {
+        if constexpr (std::is_invocable_r_v<bool, const Target&, size_t>)
+            return target(node);
+        else {
+            const std::optional<size_t> single = target;
+            return single && *single == node;
+        }
+    }
+
+    // --- kernel -----------------------------------------------------------------------------------------------------
+
+    /// Dijkstra/A* from source on the given edges. Stops as soon as target is settled (see Target above), computes
+    /// the complete shortest-path tree if there is no target. Heuristic values are computed lazily when a node is first
+    /// reached. Results (dists, predecessors, visited) are left in the workspace. Returns false if interrupt() stopped the search.
+    template <typename Queue = BinaryHeap, typename Heuristic = NoHeuristic, typename Stats = NoStats, typename Edges = OutgoingEdges, typename Interrupt = NeverInterrupt, typename Target = std::optional<size_t>>
+    bool run(ShortestPaths::SearchWorkspace& ws, size_t num_nodes, size_t source, const Target& target, const Heuristic& heuristic, Stats& stats, const Edges& edges, const Interrupt& interrupt = {})
+    {
+        TRACE_SCOPE("search");
+        ws.reset(num_nodes);
+        if constexpr (Heuristic::enabled) {
+            TRACE_SCOPE("heuristic setup");
+            ws.heuristics.assign(num_nodes, -1.0f);
+        }
+        const auto estimate = [&](size_t node) -> float {
+            if constexpr (Heuristic::enabled) {
+                float& h = ws.heuristics[node];
+                if (h < 0.0f) {
+                    h = heuristic(node);
+                    stats.heuristic_evaluated();
+                }
+                return h;
+            }
+            else
+                return 0.0f;
+        };
+
+        ws.dists.at(source) = 0.0f;
+        Queue::push(ws.queue, {estimate(source), source});
+        while (!ws.queue.empty()) {
+            const size_t elem = Queue::pop(ws.queue).second;
+            // outdated entry, the node has been settled with a shorter distance already
+            if (ws.visited[elem])
+                continue;
+            ws.visited[elem] = true;
+            stats.settled();
+            if (reached(target, elem))
+                break;
+            if (interrupt())
+                return false;
+
+            const float dist = ws.dists[elem];
+            edges(elem, [&](size_t i, float weight) {
+                if (ws.visited[i])
+                    return;
+                const float new_dist = dist+weight;
+                if (new_dist < ws.dists[i]) {
+                    ws.dists[i] = new_dist;
+                    ws.predecessors[i] = elem;
+                    stats.relaxed();
+                    Queue::push(ws.queue, {new_dist+estimate(i), i});
+                }
+            });
+        }
+        return true;
+    }
+
+    /// the path from the source of the last search to target, empty if target was not reached
+    template <typename Path = std::vector<size_t>>
+    Path extract_path(const ShortestPaths::SearchWorkspace& ws, size_t target, const typename Path::allocator_type& allocator = {})
+    {
+        TRACE_SCOPE("path reconstruction");
+        Path path(allocator);
+        if (ws.dists[target] == INFINITY)
+            return path;
+        for (std::optional<size_t> elem = target; elem; elem = ws.predecessors[*elem])
+            path.push_back(*elem);
+        std::reverse(path.begin(), path.end());
+        return path;
+    }
+
+    /// shortest path between two original ids with the given policies, in original ids; the heuristic is
+    /// evaluated on internal ids (e.g. EuclideanHeuristic(graph, graph.to_internal(to)))
+    template <typename Queue = BinaryHeap, typename Heuristic = NoHeuristic, typename Stats = NoStats>
+    std::vector<size_t> shortest_path(const ShortestPaths& graph, size_t from, size_t to, const Heuristic& heuristic, Stats& stats)
+    {
+        thread_local ShortestPaths::SearchWorkspace ws;
+        const size_t target = graph.to_internal(to);
+        run<Queue>(ws, graph.size(), graph.to_internal(from), target, heuristic, stats, OutgoingEdges(graph));
+        std::vector<size_t> path = extract_path(ws, target);
+        for (size_t& node : path)
+            node = graph.to_external(node);
+        return path;
+    }
+
+    /// as above, but the workspace and the returned path are allocated from resource
+    template <typename Queue = BinaryHeap, typename Heuristic = NoHeuristic, typename Stats = NoStats>
+    std::pmr::vector<size_t> shortest_path(const ShortestPaths& graph, size_t from, size_t to, const Heuristic& heuristic, Stats& stats, std::pmr::memory_resource* resource)
+    {
+        ShortestPaths::SearchWorkspace ws(resource);
+        const size_t target = graph.to_internal(to);
+        run<Queue>(ws, graph.size(), graph.to_internal(from), target, heuristic, stats, OutgoingEdges(graph));
+        auto path = extract_path<std::pmr::vector<size_t>>(ws, target, resource);
+        for (size_t& node : path)
+            node = graph.to_external(node);
+        return path;
+    }
+}
@@ -1,11 +1,21 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <limits>
 #include <vector>
 #include <string>
 #include <optional>
 #include <functional>
+#include <memory>
+#include <memory_resource>
+#include <span>
+
+#include "query_executor.h"
+#include "spatial_index.h"
+
+class ReachIndex;
+namespace search { class AdjacencyLists; }
 
 class ShortestPaths {
 public:
@@ -18,17 +28,76 @@ public:
         /// position for computing the A* heuristic (not for Dijkstra!)
         float pos_x, pos_y;
 
-        // use these to access distances
-        std::optional<float>& operator[](size_t i) { return distances.at(i); }
-        const std::optional<float>& operator[](size_t i) const { return distances.at(i); }
-        std::optional<float>& at(size_t i) { return distances.at(i); }
-        const std::optional<float>& at(size_t i) const { return distances.at(i); }
+        // use these to access distances (by the original id of the other node)
+        std::optional<float>& operator[](size_t i) { return distances.at(column(i)); }
+        const std::optional<float>& operator[](size_t i) const { return distances.at(column(i)); }
+        std::optional<float>& at(size_t i) { return distances.at(column(i)); }
+        const std::optional<float>& at(size_t i) const { return distances.at(column(i)); }
+        /// the whole row without bounds checks, indexed by internal ids, for the search kernels
+        const std::vector<std::optional<float>>& row() const { return distances; }
 
         void resize(size_t num_nodes) { distances.resize(num_nodes); }
 
     private:
-        /// distances towards other nodes or no value if not connected
+        friend class ShortestPaths;
+
+        size_t column(size_t original_id) const { return internal_ids ? internal_ids->at(original_id) : original_id; }
+
+        /// distances towards other nodes or no value if not connected, in storage order
         std::vector<std::optional<float>> distances;
+        /// the id map of the graph (see ShortestPaths::reorder), shared by all rows and copies; null if not reordered
+        std::shared_ptr<const std::vector<size_t>> internal_ids;
+    };
+
+    /// a route through the graph together with its total length
+    struct Route {
+        std::vector<size_t> path;
+        float length = 0.0f;
+    };
+
+    /// acceptance criteria for alternative routes (see compute_alternatives)
+    struct AlternativeOptions {
+        /// maximum number of alternatives returned in addition to the optimal route
+        size_t max_alternatives = 3;
+        /// an alternative may be at most this factor longer than the optimal route (bounded stretch)
+        float max_stretch = 1.25f;
+        /// at most this fraction of the optimal length may be shared with already accepted routes (limited sharing)
+        float max_sharing = 0.8f;
+        /// every subpath of up to this fraction of the optimal length has to be a shortest path (local optimality)
+        float local_optimality = 0.25f;
+        /// at most this many via-node candidates (the shortest ones that pass the other criteria) are tested for local
+        /// optimality, every test is a search of its own. This trades alternatives for time, but weakly: on de.csv 64
+        /// finds 1.8 alternatives per query where no limit finds 2.0 and 16 finds 1.4, while the time changes by less
+        /// than a fifth because the penalty method runs more rounds when fewer alternatives were accepted
+        size_t max_local_tests = 64;
+    };
+
+    /// node orderings for reorder()
+    enum class NodeOrder {
+        /// along a Hilbert curve over the node positions
+        Hilbert,
+        /// breadth-first search order over the (undirected) edges
+        BFS,
+        /// reverse Cuthill-McKee: BFS from a peripheral node with neighbors sorted by degree, reversed
+        RCM,
+    };
+
+    /// scratch memory of a single search; reusing one instance avoids reallocating it for every search
+    /// all memory is taken from the given memory resource (the global heap by default)
+    struct SearchWorkspace {
+        SearchWorkspace() = default;
+        explicit SearchWorkspace(std::pmr::memory_resource* resource)
+            : dists(resource), predecessors(resource), visited(resource), heuristics(resource), queue(resource) {}
+
+        std::pmr::vector<float> dists;
+        std::pmr::vector<std::optional<size_t>> predecessors;
+        std::pmr::vector<bool> visited;
+        /// lazily computed heuristic values, negative if not computed yet (only used by A* searches)
+        std::pmr::vector<float> heuristics;
+        /// min-heap of (tentative distance + heuristic, node), may contain outdated entries
+        std::pmr::vector<std::pair<float, size_t>> queue;
+
+        void reset(size_t num_nodes);
     };
 
 public:
@@ -36,28 +105,100 @@ public:
     ShortestPaths(size_t num_nodes) { resize(num_nodes); }
 
     void resize(size_t num_nodes) {
+        if (!external_ids.empty())
+            resize_id_map(num_nodes);
         adjacency_matrix.resize(num_nodes);
         for (auto& row : adjacency_matrix)
             row.resize(num_nodes);
+        if (!external_ids.empty())
+            share_id_map();
+        spatial_index = SpatialIndex{};
     }
 
     size_t size() const { return adjacency_matrix.size(); }
 
-    // use these to access nodes and edges
-    Location& operator[](size_t i) { return adjacency_matrix.at(i); }
-    const Location& operator[](size_t i) const { return adjacency_matrix.at(i); }
-    Location& at(size_t i) { return adjacency_matrix.at(i); }
-    const Location& at(size_t i) const { return adjacency_matrix.at(i); }
+    // use these to access nodes and edges by their original ids, also after reorder()
+    Location& operator[](size_t i) { return adjacency_matrix.at(to_internal(i)); }
+    const Location& operator[](size_t i) const { return adjacency_matrix.at(to_internal(i)); }
+    Location& at(size_t i) { return adjacency_matrix.at(to_internal(i)); }
+    const Location& at(size_t i) const { return adjacency_matrix.at(to_internal(i)); }
+    /// a node by its internal (storage) id, for the search kernels, which work on internal ids throughout;
+    /// Location::row() is indexed by internal ids as well
+    const Location& internal_node(size_t internal_id) const { return adjacency_matrix[internal_id]; }
 
+    /// returns the original id of the node
     size_t getNodeIdByName(const std::string& name) const;
 
+    /// renumbers the nodes so that neighbors are close in memory. Node and edge storage is permuted, queries and the
+    /// accessors above keep taking and returning the original ids; only internal_node() and Location::row() expose
+    /// the storage order.
+    void reorder(NodeOrder strategy);
+    size_t to_internal(size_t original_id) const { return internal_ids.empty() ? original_id : internal_ids.at(original_id); }
+    size_t to_external(size_t internal_id) const { return external_ids.empty() ? internal_id : external_ids.at(internal_id); }
+
+    /// builds the spatial index over Location::pos_x/pos_y - call again after adding or moving nodes
+    void build_spatial_index();
+    /// the node closest to (x, y), requires build_spatial_index()
+    size_t nearest_node(float x, float y) const;
+    /// all nodes within distance r of (x, y), requires build_spatial_index()
+    std::vector<size_t> nodes_in_radius(float x, float y, float r) const;
+
+    /// binary snapshot of nodes, edges and the spatial index (if built)
+    void save_snapshot(const std::string& filename) const;
+    static ShortestPaths load_snapshot(const std::string& filename);
+
     std::vector<size_t> compute_shortest_path(const std::string& from, const std::string& to) const {
         return compute_shortest_path(getNodeIdByName(from), getNodeIdByName(to));
     }
 
     std::vector<size_t> compute_shortest_path(size_t from, size_t to) const;
+    /// Same search without printing, with the workspace and the result allocated from resource. If resource is nullptr,
+    /// the arena of the calling thread (QueryArena::this_thread) is reset and used: the returned path then stays
+    /// valid until the next query on this thread, and warmed-up queries do not touch the global heap.
+    std::pmr::vector<size_t> compute_shortest_path(size_t from, size_t to, std::pmr::memory_resource* resource) const;
+    /// the same A* search, but nodes that cannot lie on a shortest path according to their reach bound are skipped
+    std::vector<size_t> compute_shortest_path(size_t from, size_t to, const ReachIndex& reach) const;
+
+    /// starts the worker threads for async_compute_shortest_path (replacing previous ones); copies of the graph share them
+    void start_executor(size_t num_threads = std::max(1u, std::thread::hardware_concurrency()), size_t queue_capacity = 1024);
+    /// queues a shortest path query on the executor, blocking while its queue is full; the graph must neither be
+    /// modified nor destroyed before the result is available
+    AsyncResult<std::vector<size_t>> async_compute_shortest_path(size_t from, size_t to) const;
+
+    /// the route to the closest of the targets, found by a single A* search towards the nearest target that stops as
+    /// soon as the first target is settled (empty path and infinite length if no target is reachable)
+    Route compute_shortest_path_to_any(size_t from, std::span<const size_t> targets) const;
+    /// the routes to all targets (in the order of targets) from a single search that stops as soon as the last
+    /// target is settled; unreachable targets get an empty path and infinite length
+    std::vector<Route> compute_shortest_paths_to_all(size_t from, std::span<const size_t> targets) const;
+
+    std::vector<Route> compute_alternatives(const std::string& from, const std::string& to) const {
+        return compute_alternatives(getNodeIdByName(from), getNodeIdByName(to));
+    }
+
+    /// returns the optimal route followed by up to options.max_alternatives alternatives
+    /// (empty if to is not reachable from from); on the matrix a call takes about 4x (3000 nodes) to 9x (de.csv) the
+    /// time of compute_shortest_path, since the searches around both ends scan a matrix row per settled node
+    std::vector<Route> compute_alternatives(size_t from, size_t to, const AlternativeOptions& options) const;
+    /// the same routes with the edges taken from prebuilt adjacency lists of this graph instead of the matrix rows,
+    /// which brings a call down to about 1.5x (3000 nodes) to 6x (de.csv) the time of compute_shortest_path when many
+    /// routes are computed on the same graph
+    std::vector<Route> compute_alternatives(size_t from, size_t to, const AlternativeOptions& options, const search::AdjacencyLists& lists) const;
+    std::vector<Route> compute_alternatives(size_t from, size_t to) const { return compute_alternatives(from, to, AlternativeOptions{}); }
 
 private:
     // adjacency_matrix - contains all locations and a full list of distances between all nodes
     std::vector<Location> adjacency_matrix;
+    /// grid over the node positions, empty until build_spatial_index() is called
+    SpatialIndex spatial_index;
+    /// original id of every stored node and its inverse, both empty as long as the nodes were never reordered
+    std::vector<size_t> external_ids;
+    std::vector<size_t> internal_ids;
+
+    void resize_id_map(size_t num_nodes);
+    /// hands internal_ids to every row, for the accessors of Location
+    void share_id_map();
+
+    /// worker threads for asynchronous queries, started by start_executor()
+    std::shared_ptr<QueryExecutor> executor;
 };
@@ -0,0 +1,175 @@
+#include "spatial_index.h"
+#include "binary_io.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+SpatialIndex::SpatialIndex(const std::vector<float>& xs, const std::vector<float>& ys)
+{
+    if (xs.size() != ys.size())
+        throw std::invalid_argument("coordinate arrays differ in size");
+    if (xs.size() >= std::numeric_limits<uint32_t>::max())
+        throw std::length_error("too many points for the spatial index");
+    const size_t num_points = xs.size();
+    if (num_points == 0)
+        return;
+
+    const auto [x_lo, x_hi] = std::minmax_element(xs.begin(), xs.end());
+    const auto [y_lo, y_hi] = std::minmax_element(ys.begin(), ys.end());
+    min_x = *x_lo;
+    min_y = *y_lo;
+    const float width = *x_hi-min_x;
+    const float height = *y_hi-min_y;
+
+    // aim for about two points per cell
+    const float num_cells = std::max(1.0f, static_cast<float>(num_points)/2.0f);
+    cell_size = std::sqrt(std::max(width*height, std::numeric_limits<float>::min())/num_cells);
+    // degenerate extents (all points on a line) would produce a huge grid along the other axis
+    cell_size = std::max(cell_size, std::max(width, height)/num_cells);
+    if (!(cell_size > 0.0f))
+        cell_size = 1.0f;
+    cells_x = static_cast<uint32_t>(width/cell_size)+1;
+    cells_y = static_cast<uint32_t>(height/cell_size)+1;
+
+    // counting sort of the points by cell
+    const size_t total_cells = static_cast<size_t>(cells_x)*cells_y;
+    std::vector<uint32_t> point_cell(num_points);
+    cell_offsets.assign(total_cells+1, 0);
+    for (size_t i=0; i<num_points; ++i) {
+        point_cell[i] = static_cast<uint32_t>(cell_y(ys[i])*cells_x+cell_x(xs[i]));
+        ++cell_offsets[point_cell[i]+1];
+    }
+    for (size_t c=0; c<total_cells; ++c)
+        cell_offsets[c+1] += cell_offsets[c];
+
+    point_x.resize(num_points);
+    point_y.resize(num_points);
+    ids.resize(num_points);
+    std::vector<uint32_t> fill(cell_offsets.begin(), cell_offsets.end()-1);
+    for (size_t i=0; i<num_points; ++i) {
+        const uint32_t slot = fill[point_cell[i]]++;
+        point_x[slot] = xs[i];
+        point_y[slot] = ys[i];
+        ids[slot] = static_cast<uint32_t>(i);
+    }
+}
+
+size_t SpatialIndex::cell_x(float x) const
+{
+    const float c = std::floor((x-min_x)/cell_size);
+    return static_cast<size_t>(std::clamp(c, 0.0f, static_cast<float>(cells_x-1)));
+}
+
+size_t SpatialIndex::cell_y(float y) const
+{
+    const float c = std::floor((y-min_y)/cell_size);
+    return static_cast<size_t>(std::clamp(c, 0.0f, static_cast<float>(cells_y-1)));
+}
+
+template <typename Visitor>
+void SpatialIndex::visit_cell(size_t cx, size_t cy, float x, float y, Visitor&& visit) const
+{
+    const size_t c = cy*cells_x+cx;
+    for (uint32_t p=cell_offsets[c]; p<cell_offsets[c+1]; ++p) {
+        const float dx = point_x[p]-x;
+        const float dy = point_y[p]-y;
+        visit(ids[p], dx*dx+dy*dy);
+    }
+}
+
+std::optional<size_t> SpatialIndex::nearest(float x, float y) const
+{
+    if (empty())
+        return std::nullopt;
+
+    const long cx = static_cast<long>(cell_x(x));
+    const long cy = static_cast<long>(cell_y(y));
+    const long max_cx = static_cast<long>(cells_x)-1;
+    const long max_cy = static_cast<long>(cells_y)-1;
+
+    uint32_t best = 0;
+    float best_dist = std::numeric_limits<float>::infinity();
+    const auto visit = [&](uint32_t id, float dist) {
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = id;
+        }
+    };
+
+    // search square rings of cells around the query cell until no unsearched cell can be closer than the best point
+    for (long ring=0; ; ++ring) {
+        const long x0 = cx-ring, x1 = cx+ring, y0 = cy-ring, y1 = cy+ring;
+        for (long j=std::max(y0, 0l); j<=std::min(y1, max_cy); ++j) {
+            const bool row_on_ring = j == y0 || j == y1;
+            for (long i=std::max(x0, 0l); i<=std::min(x1, max_cx); ++i) {
+                if (row_on_ring || i == x0 || i == x1)
+                    visit_cell(static_cast<size_t>(i), static_cast<size_t>(j), x, y, visit);
+            }
+        }
+
+        // lower bound for the distance of all points outside of the searched square
+        float bound = std::numeric_limits<float>::infinity();
+        if (x0 > 0)
+            bound = std::min(bound, x-(min_x+static_cast<float>(x0)*cell_size));
+        if (x1 < max_cx)
+            bound = std::min(bound, min_x+static_cast<float>(x1+1)*cell_size-x);
+        if (y0 > 0)
+            bound = std::min(bound, y-(min_y+static_cast<float>(y0)*cell_size));
+        if (y1 < max_cy)
+            bound = std::min(bound, min_y+static_cast<float>(y1+1)*cell_size-y);
+        if (bound == std::numeric_limits<float>::infinity() || (bound > 0.0f && bound*bound >= best_dist))
+            break;
+    }
+    return best;
+}
+
+std::vector<size_t> SpatialIndex::in_radius(float x, float y, float r) const
+{
+    std::vector<size_t> result;
+    if (empty() || r < 0.0f)
+        return result;
+
+    const float r2 = r*r;
+    const size_t x0 = cell_x(x-r), x1 = cell_x(x+r);
+    const size_t y0 = cell_y(y-r), y1 = cell_y(y+r);
+    for (size_t j=y0; j<=y1; ++j)
+        for (size_t i=x0; i<=x1; ++i)
+            visit_cell(i, j, x, y, [&](uint32_t id, float dist) {
+                if (dist <= r2)
+                    result.push_back(id);
+            });
+    return result;
+}
+
+void SpatialIndex::write(std::ostream& stream) const
+{
+    binary_io::write_value(stream, min_x);
+    binary_io::write_value(stream, min_y);
+    binary_io::write_value(stream, cell_size);
+    binary_io::write_value(stream, cells_x);
+    binary_io::write_value(stream, cells_y);
+    binary_io::write_array(stream, cell_offsets);
+    binary_io::write_array(stream, point_x);
+    binary_io::write_array(stream, point_y);
+    binary_io::write_array(stream, ids);
+}
+
+SpatialIndex SpatialIndex::read(std::istream& stream)
+{
+    SpatialIndex index;
+    index.min_x = binary_io::read_value<float>(stream);
+    index.min_y = binary_io::read_value<float>(stream);
+    index.cell_size = binary_io::read_value<float>(stream);
+    index.cells_x = binary_io::read_value<uint32_t>(stream);
+    index.cells_y = binary_io::read_value<uint32_t>(stream);
+    index.cell_offsets = binary_io::read_array<uint32_t>(stream);
+    index.point_x = binary_io::read_array<float>(stream);
+    index.point_y = binary_io::read_array<float>(stream);
+    index.ids = binary_io::read_array<uint32_t>(stream);
+
+    const size_t total_cells = static_cast<size_t>(index.cells_x)*index.cells_y;
+    if (!index.ids.empty() && (index.cell_offsets.size() != total_cells+1 || index.point_x.size() != index.ids.size() || index.point_y.size() != index.ids.size()))
+        throw std::runtime_error("corrupt spatial index in snapshot");
+    return index;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+/// static uniform grid over 2d points for nearest neighbor and radius queries
+/// the points are stored sorted by grid cell, so each cell is a contiguous range
+class SpatialIndex {
+public:
+    SpatialIndex() = default;
+    /// builds the index over the points (xs[i], ys[i]); ids returned by queries are indices into these arrays
+    SpatialIndex(const std::vector<float>& xs, const std::vector<float>& ys);
+
+    /// number of indexed points
+    size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+
+    /// the point closest to (x, y) or no value if the index is empty
+    std::optional<size_t> nearest(float x, float y) const;
+    /// all points within (euclidean) distance r of (x, y), in no particular order
+    std::vector<size_t> in_radius(float x, float y, float r) const;
+
+    void write(std::ostream& stream) const;
+    static SpatialIndex read(std::istream& stream);
+
+private:
+    size_t cell_x(float x) const;
+    size_t cell_y(float y) const;
+    /// calls visit(id, squared distance) for all points in the cell
+    template <typename Visitor>
+    void visit_cell(size_t cx, size_t cy, float x, float y, Visitor&& visit) const;
+
+    float min_x = 0.0f, min_y = 0.0f;
+    float cell_size = 1.0f;
+    uint32_t cells_x = 0, cells_y = 0;
+    /// points of cell c are at [cell_offsets[c], cell_offsets[c+1])
+    std::vector<uint32_t> cell_offsets;
+    std::vector<float> point_x, point_y;
+    std::vector<uint32_t> ids;
+};
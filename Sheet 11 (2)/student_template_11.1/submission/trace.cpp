@@ -0,0 +1,86 @@
+#include "trace.h"
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+    /// buffers of all threads that ever recorded an event
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<trace::ThreadBuffer>> buffers;
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    void write_name(std::ostream& stream, const char* name)
+    {
+        stream << '"';
+        for (const char* c = name ? name : "?"; *c; ++c) {
+            if (*c == '"' || *c == '\\')
+                stream << '\\';
+            stream << *c;
+        }
+        stream << '"';
+    }
+}
+
+trace::ThreadBuffer& trace::this_thread()
+{
+    thread_local const std::shared_ptr<ThreadBuffer> buffer = [] {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.buffers.push_back(std::make_shared<ThreadBuffer>(static_cast<uint32_t>(r.buffers.size()+1)));
+        return r.buffers.back();
+    }();
+    return *buffer;
+}
+
+uint64_t trace::now_ns()
+{
+    static const auto origin = std::chrono::steady_clock::now();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-origin).count());
+}
+
+void trace::write_chrome_trace(std::ostream& stream)
+{
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        buffers = r.buffers;
+    }
+
+    // timestamps and durations are in microseconds
+    stream << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    bool first = true;
+    for (const auto& buffer : buffers) {
+        buffer->for_each([&](const ThreadBuffer::Event& event) {
+            stream << (first ? "\n" : ",\n") << "{\"name\": ";
+            first = false;
+            write_name(stream, event.name);
+            stream << ", \"pid\": 1, \"tid\": " << buffer->id() << ", \"ts\": " << static_cast<double>(event.start_ns)/1000.0;
+            if (event.type == EventType::Scope)
+                stream << ", \"ph\": \"X\", \"dur\": " << static_cast<double>(event.value)/1000.0 << "}";
+            else
+                stream << ", \"ph\": \"C\", \"args\": {\"value\": " << event.value << "}}";
+        });
+    }
+    stream << "\n]}\n";
+}
+
+void trace::write_chrome_trace(const std::string& filename)
+{
+    std::ofstream file(filename, std::ofstream::out|std::ofstream::trunc);
+    if (!file)
+        throw std::runtime_error("cannot open "+filename);
+    write_chrome_trace(file);
+    if (!file)
+        throw std::runtime_error("writing "+filename+" failed");
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/// Opt-in instrumentation of the routing code: scoped timers and counters are recorded into a lock-free ring buffer
+/// per thread and can be exported in the Chrome trace format (chrome://tracing, Perfetto).
+///
+/// Recording is compiled in with the CMake option ENABLE_TRACING (which defines SHORTEST_PATHS_TRACING). Without it,
+/// TRACE_SCOPE and TRACE_COUNTER expand to nothing and their arguments are not evaluated; the export functions then
+/// write an empty trace.
+namespace trace {
+
+#ifdef SHORTEST_PATHS_TRACING
+    constexpr bool enabled = true;
+#else
+    constexpr bool enabled = false;
+#endif
+
+    enum class EventType : uint8_t { Scope, Counter };
+
+    /// Events of one thread. Only the owning thread records, it never waits; the buffer keeps the latest capacity
+    /// events. Readers may copy the events at any time and drop the ones that were overwritten meanwhile.
+    class ThreadBuffer {
+    public:
+        static constexpr size_t capacity = 1 << 16;
+
+        struct Event {
+            /// must point to a string with static storage duration, e.g. a literal
+            const char* name;
+            EventType type;
+            uint64_t start_ns;
+            /// duration in nanoseconds for scopes, the value for counters
+            uint64_t value;
+        };
+
+        explicit ThreadBuffer(uint32_t id) : thread_id(id) {}
+
+        void record(const char* name, EventType type, uint64_t start_ns, uint64_t value) noexcept {
+            const uint64_t index = written.load(std::memory_order_relaxed);
+            // a reader that sees any of the following stores also sees that the slot of index is being overwritten
+            std::atomic_thread_fence(std::memory_order_release);
+            Slot& slot = slots[index%capacity];
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.type.store(type, std::memory_order_relaxed);
+            slot.start_ns.store(start_ns, std::memory_order_relaxed);
+            slot.value.store(value, std::memory_order_relaxed);
+            written.store(index+1, std::memory_order_release);
+        }
+
+        /// calls visit(event) for every complete event in the buffer, oldest first
+        template <typename Visitor>
+        void for_each(Visitor&& visit) const;
+
+        uint32_t id() const { return thread_id; }
+
+    private:
+        struct Slot {
+            std::atomic<const char*> name {nullptr};
+            std::atomic<EventType> type {EventType::Scope};
+            std::atomic<uint64_t> start_ns {0};
+            std::atomic<uint64_t> value {0};
+        };
+
+        uint32_t thread_id;
+        std::atomic<uint64_t> written {0};
+        Slot slots[capacity];
+    };
+
+    /// buffer of the calling thread, registered on first use; it outlives the thread so its events can still be exported
+    ThreadBuffer& this_thread();
+    /// nanoseconds since the start of tracing
+    uint64_t now_ns();
+
+    /// records the time between construction and destruction
+    class Scope {
+    public:
+        explicit Scope(const char* n) : name(n), start_ns(now_ns()) {}
+        ~Scope() { this_thread().record(name, EventType::Scope, start_ns, now_ns()-start_ns); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name;
+        uint64_t start_ns;
+    };
+
+    inline void counter(const char* name, uint64_t value) { this_thread().record(name, EventType::Counter, now_ns(), value); }
+
+    /// all events of all threads as a Chrome trace JSON object
+    void write_chrome_trace(std::ostream& stream);
+    void write_chrome_trace(const std::string& filename);
+
+    template <typename Visitor>
+    void ThreadBuffer::for_each(Visitor&& visit) const
+    {
+        const uint64_t end = written.load(std::memory_order_acquire);
+        for (uint64_t index = end > capacity ? end-capacity : 0; index<end; ++index) {
+            const Slot& slot = slots[index%capacity];
+            const Event event {slot.name.load(std::memory_order_relaxed), slot.type.load(std::memory_order_relaxed),
+                               slot.start_ns.load(std::memory_order_relaxed), slot.value.load(std::memory_order_relaxed)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // the writer may have started to overwrite the slot with index+capacity in the meantime
+            if (written.load(std::memory_order_relaxed) >= index+capacity)
+                continue;
+            visit(event);
+        }
+    }
+}
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#ifdef SHORTEST_PATHS_TRACING
+/// times the rest of the enclosing block
+#define TRACE_SCOPE(name) const ::trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) ::trace::counter((name), static_cast<uint64_t>(value))
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#define TRACE_COUNTER(name, value) static_cast<void>(0)
+#endif
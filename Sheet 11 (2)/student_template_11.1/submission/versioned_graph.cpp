@@ -0,0 +1,206 @@
+#include "versioned_graph.h"
+#include "search_kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+    /// rows of one block while it is being changed
+    using DecodedBlock = std::vector<std::vector<std::pair<uint32_t, float>>>;
+
+    DecodedBlock decode(const VersionedGraph::EdgeBlock& block)
+    {
+        DecodedBlock rows(VersionedGraph::block_size);
+        for (size_t i=0; i<VersionedGraph::block_size; ++i)
+            for (uint32_t e=block.offsets[i]; e<block.offsets[i+1]; ++e)
+                rows[i].emplace_back(block.targets[e], block.weights[e]);
+        return rows;
+    }
+
+    std::shared_ptr<const VersionedGraph::EdgeBlock> encode(const DecodedBlock& rows)
+    {
+        auto block = std::make_shared<VersionedGraph::EdgeBlock>();
+        for (size_t i=0; i<VersionedGraph::block_size; ++i) {
+            for (const auto& [target, weight] : rows[i]) {
+                block->targets.push_back(target);
+                block->weights.push_back(weight);
+            }
+            block->offsets[i+1] = static_cast<uint32_t>(block->targets.size());
+        }
+        return block;
+    }
+
+    /// whether weight is below the straight-line distance of its nodes (allowing for rounding)
+    bool is_short(const VersionedGraph::Nodes& nodes, size_t u, size_t v, float weight)
+    {
+        return weight < std::hypot(nodes.pos_x[u]-nodes.pos_x[v], nodes.pos_y[u]-nodes.pos_y[v])*(1.0f-1e-5f);
+    }
+}
+
+std::optional<float> VersionedGraph::Version::edge(size_t from, size_t to) const
+{
+    if (from >= size() || to >= size())
+        throw std::out_of_range("node id out of range");
+    const size_t target = nodes->to_internal(to);
+    std::optional<float> weight;
+    edges(nodes->to_internal(from), [&](size_t v, float w) {
+        if (v == target)
+            weight = w;
+    });
+    return weight;
+}
+
+ShortestPaths::Route VersionedGraph::Version::compute_shortest_path(size_t from, size_t to) const
+{
+    if (from >= size() || to >= size())
+        throw std::out_of_range("node id out of range");
+    const size_t source = nodes->to_internal(from);
+    const size_t target = nodes->to_internal(to);
+
+    thread_local ShortestPaths::SearchWorkspace ws;
+    search::NoStats stats;
+    const auto version_edges = [this](size_t u, auto&& visit) { edges(u, visit); };
+    if (num_short_edges == 0) {
+        const float target_x = nodes->pos_x[target];
+        const float target_y = nodes->pos_y[target];
+        const auto euclidean = search::UserHeuristic{[&](size_t node) { return std::hypot(target_x-nodes->pos_x[node], target_y-nodes->pos_y[node]); }};
+        search::run(ws, size(), source, target, euclidean, stats, version_edges);
+    }
+    else
+        search::run(ws, size(), source, target, search::NoHeuristic{}, stats, version_edges);
+
+    ShortestPaths::Route route {search::extract_path(ws, target), ws.dists[target]};
+    for (size_t& node : route.path)
+        node = nodes->to_external(node);
+    return route;
+}
+
+VersionedGraph::VersionedGraph(const ShortestPaths& graph)
+{
+    const size_t num_nodes = graph.size();
+    if (num_nodes >= std::numeric_limits<uint32_t>::max())
+        throw std::length_error("too many nodes for a versioned graph");
+
+    bool reordered = false;
+    for (size_t u=0; u<num_nodes; ++u) {
+        nodes.pos_x.push_back(graph.internal_node(u).pos_x);
+        nodes.pos_y.push_back(graph.internal_node(u).pos_y);
+        nodes.external_ids.push_back(graph.to_external(u));
+        reordered = reordered || nodes.external_ids.back() != u;
+    }
+    if (reordered) {
+        nodes.internal_ids.assign(num_nodes, 0);
+        for (size_t u=0; u<num_nodes; ++u)
+            nodes.internal_ids[nodes.external_ids[u]] = u;
+    }
+    else
+        nodes.external_ids.clear();
+
+    auto version = std::make_unique<Version>();
+    version->nodes = &nodes;
+    for (size_t first=0; first<num_nodes; first+=block_size) {
+        DecodedBlock rows(block_size);
+        for (size_t u=first; u<std::min(first+block_size, num_nodes); ++u) {
+            const auto& row = graph.internal_node(u).row();
+            for (size_t v=0; v<num_nodes; ++v) {
+                if (!row[v])
+                    continue;
+                rows[u-first].emplace_back(static_cast<uint32_t>(v), *row[v]);
+                if (is_short(nodes, u, v, *row[v]))
+                    ++version->num_short_edges;
+            }
+        }
+        version->blocks.push_back(encode(rows));
+    }
+    current.store(version.release());
+}
+
+VersionedGraph::~VersionedGraph()
+{
+    delete current.load();
+}
+
+VersionedGraph::ReadGuard VersionedGraph::read() const
+{
+    // start at the slot this thread used last, which is most likely free again
+    thread_local size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    for (size_t attempt=0; ; ++attempt) {
+        const size_t i = (hint+attempt)%max_readers;
+        uint64_t free = 0;
+        // announcing an epoch that is already outdated is safe, it only keeps more versions alive
+        if (readers[i].epoch.compare_exchange_strong(free, epoch.load())) {
+            hint = i;
+            return ReadGuard(&readers[i].epoch, current.load());
+        }
+        if (attempt%max_readers == max_readers-1)
+            std::this_thread::yield();
+    }
+}
+
+uint64_t VersionedGraph::publish(std::span<const EdgeChange> changes)
+{
+    std::lock_guard<std::mutex> lock(writer);
+    const Version& old = *current.load();
+    for (const EdgeChange& change : changes) {
+        if (change.from >= old.size() || change.to >= old.size())
+            throw std::out_of_range("node id out of range");
+        if (change.weight && !(*change.weight >= 0.0f && std::isfinite(*change.weight)))
+            throw std::invalid_argument("edge weights have to be finite and non-negative");
+    }
+
+    // the new version shares all blocks, the ones with changed nodes are replaced below
+    auto next = std::make_unique<Version>(old);
+    next->version_number = old.version_number+1;
+    std::unordered_map<size_t, DecodedBlock> changed;
+    for (const EdgeChange& change : changes) {
+        const size_t u = nodes.to_internal(change.from);
+        const auto v = static_cast<uint32_t>(nodes.to_internal(change.to));
+        auto [block, inserted] = changed.try_emplace(u/block_size);
+        if (inserted)
+            block->second = decode(*old.blocks[u/block_size]);
+
+        auto& row = block->second[u%block_size];
+        const auto edge = std::find_if(row.begin(), row.end(), [&](const auto& entry) { return entry.first == v; });
+        if (edge != row.end()) {
+            if (is_short(nodes, u, v, edge->second))
+                --next->num_short_edges;
+            row.erase(edge);
+        }
+        if (change.weight) {
+            row.emplace_back(v, *change.weight);
+            if (is_short(nodes, u, v, *change.weight))
+                ++next->num_short_edges;
+        }
+    }
+    for (const auto& [index, rows] : changed)
+        next->blocks[index] = encode(rows);
+
+    const uint64_t number = next->version_number;
+    const Version* replaced = current.exchange(next.release());
+    // readers that pin from now on announce a later epoch and cannot see the replaced version anymore
+    retired.emplace_back(epoch.fetch_add(1), replaced);
+    reclaim_locked();
+    return number;
+}
+
+size_t VersionedGraph::reclaim()
+{
+    std::lock_guard<std::mutex> lock(writer);
+    return reclaim_locked();
+}
+
+size_t VersionedGraph::reclaim_locked()
+{
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const ReaderSlot& reader : readers)
+        if (const uint64_t pinned = reader.epoch.load(); pinned != 0)
+            oldest = std::min(oldest, pinned);
+    // a version retired in epoch e may still be in use by readers that announced e or an earlier epoch
+    std::erase_if(retired, [&](const auto& entry) { return entry.first < oldest; });
+    return retired.size();
+}
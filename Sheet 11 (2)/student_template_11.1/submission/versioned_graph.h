@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "shortest_paths.h"
+
+/// Graph for concurrent queries and updates in read-copy-update style. Every update publishes a new immutable
+/// Version; readers pin the current version without locks and keep using it, undisturbed by later updates.
+///
+/// The edges are stored in blocks of block_size consecutive nodes (compressed sparse rows per block). A new version
+/// shares all blocks with its predecessor except the ones that contain a changed node, which are copied.
+/// Replaced versions are reclaimed by epochs: a reader announces the epoch in which it pinned, publish() retires the
+/// old version in the current epoch and advances it, and a retired version is freed once no reader announces an
+/// epoch up to its own. Writers never wait for readers, readers never wait at all.
+///
+/// The nodes (count, positions, ids) are fixed; node ids are the original ids of the ShortestPaths the graph was
+/// built from, internally the nodes keep its storage order.
+class VersionedGraph {
+public:
+    static constexpr size_t block_size = 64;
+    /// maximum number of simultaneously pinned versions; further readers wait for a free slot
+    static constexpr size_t max_readers = 128;
+
+    /// outgoing edges of block_size consecutive nodes
+    struct EdgeBlock {
+        /// the edges of the i-th node of the block are [offsets[i], offsets[i+1])
+        std::array<uint32_t, block_size+1> offsets {};
+        std::vector<uint32_t> targets;
+        std::vector<float> weights;
+    };
+
+    /// node data that all versions share
+    struct Nodes {
+        std::vector<float> pos_x, pos_y;
+        /// original id of every stored node and its inverse, empty if the nodes were never reordered
+        std::vector<size_t> external_ids;
+        std::vector<size_t> internal_ids;
+
+        size_t to_internal(size_t original_id) const { return internal_ids.empty() ? original_id : internal_ids.at(original_id); }
+        size_t to_external(size_t internal_id) const { return external_ids.empty() ? internal_id : external_ids.at(internal_id); }
+    };
+
+    class Version {
+    public:
+        /// 0 for the version the graph was built with, incremented by every publish()
+        uint64_t number() const { return version_number; }
+        size_t size() const { return nodes->pos_x.size(); }
+
+        /// weight of the edge between two original ids, no value if there is none
+        std::optional<float> edge(size_t from, size_t to) const;
+        /// calls visit(v, weight) for every edge u->v, in internal ids
+        template <typename Visitor>
+        void edges(size_t u, Visitor&& visit) const {
+            const EdgeBlock& block = *blocks[u/block_size];
+            const size_t i = u%block_size;
+            for (uint32_t e=block.offsets[i]; e<block.offsets[i+1]; ++e)
+                visit(static_cast<size_t>(block.targets[e]), block.weights[e]);
+        }
+
+        /// shortest route between two original ids in this version (empty path and infinite length if not reachable);
+        /// uses A* with the straight-line distance as long as no edge is shorter than that, Dijkstra otherwise
+        ShortestPaths::Route compute_shortest_path(size_t from, size_t to) const;
+
+    private:
+        friend class VersionedGraph;
+
+        uint64_t version_number = 0;
+        const Nodes* nodes = nullptr;
+        std::vector<std::shared_ptr<const EdgeBlock>> blocks;
+        /// edges whose weight is below the distance of their nodes, which makes the Euclidean heuristic inadmissible
+        size_t num_short_edges = 0;
+    };
+
+    /// Pins the version that was current when it was created. Cheap to create and destroy (no locks, no allocation),
+    /// but it must not outlive the graph; long-lived guards delay the reclamation of all newer versions.
+    class ReadGuard {
+    public:
+        ReadGuard(ReadGuard&& other) noexcept : slot(std::exchange(other.slot, nullptr)), version(other.version) {}
+        ReadGuard& operator=(ReadGuard&&) = delete;
+        ~ReadGuard() { if (slot) slot->store(0, std::memory_order_release); }
+
+        const Version& operator*() const { return *version; }
+        const Version* operator->() const { return version; }
+
+    private:
+        friend class VersionedGraph;
+        ReadGuard(std::atomic<uint64_t>* s, const Version* v) : slot(s), version(v) {}
+
+        std::atomic<uint64_t>* slot;
+        const Version* version;
+    };
+
+    /// a new weight for the edge from -> to (inserting it if necessary), or no weight to remove it
+    struct EdgeChange {
+        size_t from, to;
+        std::optional<float> weight;
+    };
+
+    explicit VersionedGraph(const ShortestPaths& graph);
+    /// requires that no ReadGuard is left
+    ~VersionedGraph();
+    VersionedGraph(const VersionedGraph&) = delete;
+    VersionedGraph& operator=(const VersionedGraph&) = delete;
+
+    /// pins the current version, lock-free
+    ReadGuard read() const;
+
+    /// applies all changes in one new version and makes it current; returns its number. Writers are serialized,
+    /// readers are not blocked.
+    uint64_t publish(std::span<const EdgeChange> changes);
+    /// frees the retired versions that no reader can see anymore and returns how many are still waiting;
+    /// publish() calls this as well
+    size_t reclaim();
+
+private:
+    struct alignas(64) ReaderSlot {
+        /// epoch in which the reader pinned its version, 0 if the slot is free
+        std::atomic<uint64_t> epoch {0};
+    };
+
+    size_t reclaim_locked();
+
+    Nodes nodes;
+    std::atomic<const Version*> current {nullptr};
+    std::atomic<uint64_t> epoch {1};
+    mutable std::array<ReaderSlot, max_readers> readers;
+
+    /// serializes publish() and reclaim()
+    std::mutex writer;
+    /// replaced versions and the epoch in which they were retired
+    std::vector<std::pair<uint64_t, std::unique_ptr<const Version>>> retired;
+};